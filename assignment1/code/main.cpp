@@ -1,6 +1,8 @@
 #include "Triangle.hpp"
 #include "rasterizer.hpp"
 #include <eigen3/Eigen/Eigen>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <cmath>
@@ -103,6 +105,90 @@ Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio,
     return projection;
 }
 
+// 基准测试用的一个网格
+struct bench_scene
+{
+    std::string name;
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3i> indices;
+};
+
+// 合成场景：中心在 center、半径 radius 的 UV 球，rings x segments 个四边形各拆成两个三角形
+void make_sphere(const Eigen::Vector3f& center, float radius, int rings, int segments, bench_scene& scene)
+{
+    for (int i = 0; i <= rings; ++i)
+    {
+        float theta = MY_PI * i / rings;
+        for (int j = 0; j <= segments; ++j)
+        {
+            float phi = 2 * MY_PI * j / segments;
+            Eigen::Vector3f n(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+            scene.positions.push_back(center + n * radius);
+        }
+    }
+    for (int i = 0; i < rings; ++i)
+    {
+        for (int j = 0; j < segments; ++j)
+        {
+            int a = i * (segments + 1) + j, b = a + segments + 1;
+            scene.indices.emplace_back(a, b, a + 1);
+            scene.indices.emplace_back(a + 1, b, b + 1);
+        }
+    }
+}
+
+/**
+ * @brief 无窗口的基准测试
+ * 每个场景画 frames 帧，每帧绕 z 轴多转 360 / frames 度；统计每帧的耗时和各阶段的耗时、
+ * 每秒三角形数和每秒写的像素数。每个场景一行摘要打印出来，完整结果写成 JSON
+ */
+int run_benchmark(rst::rasterizer& r, const std::vector<bench_scene>& scenes, int frames, const std::string& json_path)
+{
+    std::ofstream json(json_path);
+    if (!json)
+    {
+        std::cerr << "Cannot write " << json_path << "\n";
+        return 1;
+    }
+    json << "{\n  \"frames\": " << frames << ",\n  \"runs\": [";
+    bool first = true;
+    for (auto& scene : scenes)
+    {
+        auto pos_id = r.load_positions(scene.positions);
+        auto ind_id = r.load_indices(scene.indices);
+
+        rst::draw_stats total;
+        double total_ms = 0;
+        for (int f = 0; f < frames; ++f)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.set_model(get_model_matrix(360.0f * f / frames));
+            auto start = std::chrono::steady_clock::now();
+            r.draw(pos_id, ind_id, rst::Primitive::Triangle);
+            total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            total += r.last_stats();
+        }
+
+        double seconds = total_ms / 1000;
+        std::cout << scene.name << ": " << total_ms / frames << " ms/frame (vertex " << total.vertex_ms / frames
+                  << ", raster " << total.raster_ms / frames << ", fragment " << total.fragment_ms / frames
+                  << ", resolve " << total.resolve_ms / frames << "), " << total.submitted / seconds << " tris/s, "
+                  << total.shaded / seconds << " frags/s\n";
+
+        json << (first ? "" : ",") << "\n    {\"scene\": \"" << scene.name << "\", \"triangles\": "
+             << scene.indices.size() << ", \"ms_per_frame\": " << total_ms / frames
+             << ", \"stage_ms\": {\"vertex\": " << total.vertex_ms / frames << ", \"raster\": "
+             << total.raster_ms / frames << ", \"fragment\": " << total.fragment_ms / frames
+             << ", \"resolve\": " << total.resolve_ms / frames << "}, \"triangles_per_s\": "
+             << total.submitted / seconds << ", \"fragments_per_s\": " << total.shaded / seconds
+             << ", \"shaded_per_frame\": " << total.shaded / frames << "}";
+        first = false;
+    }
+    json << "\n  ]\n}\n";
+    std::cout << "Wrote " << json_path << "\n";
+    return 0;
+}
+
 /**
  * @brief
  * 这里的实现没有考虑到相机的z位置对成像的影响
@@ -116,7 +202,7 @@ int main(int argc, const char **argv)
     bool command_line = false;
     std::string filename = "output.png";
 
-    if (argc >= 3)
+    if (argc >= 3 && std::string(argv[1]) != "benchmark")
     {
         command_line = true;
         angle = std::stof(argv[2]); // -r by default
@@ -140,6 +226,27 @@ int main(int argc, const char **argv)
     int key = 0;
     int frame_count = 0;
     float eye_fov = 45, aspect_ratio = 1, zNear = 0.1, zFar = 50;
+
+    // benchmark [帧数] [json=<路径>]：不开窗口，画这个三角形和一个合成的球，结果写成 JSON（默认 benchmark.json）
+    if (argc >= 2 && std::string(argv[1]) == "benchmark")
+    {
+        int frames = argc >= 3 ? std::stoi(argv[2]) : 20;
+        std::string json_path = "benchmark.json";
+        if (argc >= 4 && std::string(argv[3]).rfind("json=", 0) == 0)
+            json_path = std::string(argv[3]).substr(5);
+
+        std::vector<bench_scene> scenes(2);
+        scenes[0].name = "triangle";
+        scenes[0].positions = pos;
+        scenes[0].indices = ind;
+        scenes[1].name = "sphere";
+        make_sphere({0, 0, -2}, 1.5f, 128, 256, scenes[1]);
+        r.set_view(get_view_matrix(eye_pos));
+        // get_projection_matrix 会打印中间结果，只算一次
+        r.set_projection(get_projection_matrix(eye_fov, aspect_ratio, zNear, zFar));
+        return run_benchmark(r, scenes, frames, json_path);
+    }
+
     if (command_line)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
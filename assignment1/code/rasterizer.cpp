@@ -3,6 +3,7 @@
 //
 
 #include <algorithm>
+#include <chrono>
 #include "rasterizer.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
@@ -142,11 +143,21 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
     auto& buf = pos_buf[pos_buffer.pos_id];
     auto& ind = ind_buf[ind_buffer.ind_id];
 
+    using clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(clock::now() - since).count();
+    };
+    stats = draw_stats();
+    stats.submitted = ind.size();
+    auto start = clock::now();
+
     float f1 = (100 - 0.1) / 2.0;
     float f2 = (100 + 0.1) / 2.0;
-    std::cout << "width" << width << "\n";
-    std::cout << "height" << height << "\n";
+    // std::cout << "width" << width << "\n";
+    // std::cout << "height" << height << "\n";
     Eigen::Matrix4f mvp = projection * view * model;
+    // 先把所有三角形变换到屏幕空间，再统一画线框，两个阶段分开计时
+    screen_triangles.clear();
     for (auto& i : ind)
     {
         Triangle t;
@@ -163,17 +174,17 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
 
         for (auto & vert : v)
         {
-            std::cout << "before vert.x:" << vert.x() << "\n";
-            std::cout << "before vert.y:" << vert.y() << "\n";
-            std::cout << "before vert.z:" << vert.z() << "\n";
+            // std::cout << "before vert.x:" << vert.x() << "\n";
+            // std::cout << "before vert.y:" << vert.y() << "\n";
+            // std::cout << "before vert.z:" << vert.z() << "\n";
             vert.x() = 0.5*width*(vert.x()+1.0);
             vert.y() = 0.5*height*(vert.y()+1.0);
             // 透视除法处理深度浮点时可以转换成较大的差值，避免深度冲突
             // f1作为进位，f2就是个数 这样子确实可以确保z的大小关系不变同时可以扩大z的位数，避免精度问题
             vert.z() = vert.z() * f1 + f2;
-            std::cout << "after vert.x:" << vert.x() << "\n";
-            std::cout << "after vert.y:" << vert.y() << "\n";
-            std::cout << "after vert.z:" << vert.z() << "\n";            
+            // std::cout << "after vert.x:" << vert.x() << "\n";
+            // std::cout << "after vert.y:" << vert.y() << "\n";
+            // std::cout << "after vert.z:" << vert.z() << "\n";
         }
 
         for (int i = 0; i < 3; ++i)
@@ -187,8 +198,14 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
         t.setColor(1, 0.0  ,255.0,  0.0);
         t.setColor(2, 0.0  ,  0.0,255.0);
 
-        rasterize_wireframe(t);
+        screen_triangles.push_back(t);
     }
+    stats.vertex_ms = elapsed_ms(start);
+
+    start = clock::now();
+    for (auto& t : screen_triangles)
+        rasterize_wireframe(t);
+    stats.raster_ms = elapsed_ms(start);
 }
 
 void rst::rasterizer::rasterize_wireframe(const Triangle& t)
@@ -243,5 +260,6 @@ void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vecto
         point.y() < 0 || point.y() >= height) return;
     auto ind = (height-1-point.y())*width + point.x();
     frame_buf[ind] = color;
+    ++stats.shaded;
 }
 
@@ -6,6 +6,7 @@
 
 #include "Triangle.hpp"
 #include <algorithm>
+#include <chrono>
 #include <eigen3/Eigen/Eigen>
 using namespace Eigen;
 
@@ -47,6 +48,30 @@ struct ind_buf_id
     int ind_id = 0;
 };
 
+// 最近一次 draw 的统计：submitted 是提交的三角形，shaded 是线框写到屏幕内的像素数。
+// 各阶段耗时（毫秒）：vertex 是 MVP + 透视除法 + 视口变换，raster 是画线框；
+// 这个作业没有片元着色和 resolve，fragment、resolve 一直是 0
+struct draw_stats
+{
+    long long submitted = 0;
+    long long shaded = 0;
+    double vertex_ms = 0;
+    double raster_ms = 0;
+    double fragment_ms = 0;
+    double resolve_ms = 0;
+
+    draw_stats& operator+=(const draw_stats& o)
+    {
+        submitted += o.submitted;
+        shaded += o.shaded;
+        vertex_ms += o.vertex_ms;
+        raster_ms += o.raster_ms;
+        fragment_ms += o.fragment_ms;
+        resolve_ms += o.resolve_ms;
+        return *this;
+    }
+};
+
 class rasterizer
 {
   public:
@@ -66,6 +91,8 @@ class rasterizer
 
     std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
 
+    const draw_stats& last_stats() const { return stats; }
+
   private:
     void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
     void rasterize_wireframe(const Triangle& t);
@@ -84,6 +111,10 @@ class rasterizer
 
     int width, height;
 
+    // 顶点阶段输出的屏幕空间三角形，每次 draw 复用
+    std::vector<Triangle> screen_triangles;
+    draw_stats stats;
+
     int next_id = 0;
     int get_next_id() { return next_id++; }
 };
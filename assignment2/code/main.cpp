@@ -1,4 +1,6 @@
 // clang-format off
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include "rasterizer.hpp"
@@ -65,21 +67,139 @@ Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float z
     return projection;
 }
 
+// 基准测试用的一个网格，顶点属性按下标对应，颜色是 [0, 255]
+struct bench_scene
+{
+    std::string name;
+    std::vector<Eigen::Vector3f> positions, colors;
+    std::vector<Eigen::Vector3i> indices;
+};
+
+// 合成场景：半径 radius 的 UV 球，rings x segments 个四边形各拆成两个三角形（正面逆时针朝外），
+// 颜色随法线变化。三角形又多又小，测的是每个三角形的固定开销
+void make_sphere(float radius, int rings, int segments, bench_scene& scene)
+{
+    for (int i = 0; i <= rings; ++i)
+    {
+        float theta = MY_PI * i / rings;
+        for (int j = 0; j <= segments; ++j)
+        {
+            float phi = 2 * MY_PI * j / segments;
+            Eigen::Vector3f n(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+            scene.positions.push_back(n * radius);
+            scene.colors.push_back((n + Eigen::Vector3f::Ones()) * 127.5f);
+        }
+    }
+    for (int i = 0; i < rings; ++i)
+    {
+        for (int j = 0; j < segments; ++j)
+        {
+            int a = i * (segments + 1) + j, b = a + segments + 1;
+            scene.indices.emplace_back(a, b, a + 1);
+            scene.indices.emplace_back(a + 1, b, b + 1);
+        }
+    }
+}
+
+/**
+ * @brief 无窗口的基准测试
+ * 每个场景 x 每种 MSAA 采样数画 frames 帧，场景每帧绕 y 轴多转 360 / frames 度（场景放在 z = -3.5 附近）；
+ * 统计每帧的耗时和各阶段（顶点/光栅化/片元/resolve）的耗时、每秒三角形数和每秒着色的片元数。
+ * 每组一行摘要打印出来，完整结果写成 JSON
+ */
+int run_benchmark(rst::rasterizer& r, const std::vector<bench_scene>& scenes, int frames, const std::string& json_path)
+{
+    const int sample_counts[] = {1, 4, 16};
+
+    std::ofstream json(json_path);
+    if (!json)
+    {
+        std::cerr << "Cannot write " << json_path << "\n";
+        return 1;
+    }
+    json << "{\n  \"frames\": " << frames << ",\n  \"runs\": [";
+    bool first = true;
+    for (auto& scene : scenes)
+    {
+        auto pos_id = r.load_positions(scene.positions);
+        auto ind_id = r.load_indices(scene.indices);
+        auto col_id = r.load_colors(scene.colors);
+
+        for (int samples : sample_counts)
+        {
+            r.set_msaa(samples);
+            rst::draw_stats total;
+            double total_ms = 0;
+            for (int f = 0; f < frames; ++f)
+            {
+                // 绕场景中心 (0, 0, -3.5) 转
+                Eigen::Affine3f model = Eigen::Translation3f(0, 0, -3.5f) *
+                                        Eigen::AngleAxisf(2 * MY_PI * f / frames, Eigen::Vector3f::UnitY()) *
+                                        Eigen::Translation3f(0, 0, 3.5f);
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                r.set_model(model.matrix());
+                auto start = std::chrono::steady_clock::now();
+                r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+                total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                total += r.last_stats();
+            }
+
+            double seconds = total_ms / 1000;
+            std::cout << scene.name << " / msaa " << samples << ": " << total_ms / frames << " ms/frame (vertex "
+                      << total.vertex_ms / frames << ", raster " << total.raster_ms / frames << ", fragment "
+                      << total.fragment_ms / frames << ", resolve " << total.resolve_ms / frames << "), "
+                      << total.submitted / seconds << " tris/s, " << total.shaded / seconds << " frags/s\n";
+
+            json << (first ? "" : ",") << "\n    {\"scene\": \"" << scene.name << "\", \"msaa\": " << samples
+                 << ", \"triangles\": " << scene.indices.size() << ", \"ms_per_frame\": " << total_ms / frames
+                 << ", \"stage_ms\": {\"vertex\": " << total.vertex_ms / frames << ", \"raster\": "
+                 << total.raster_ms / frames << ", \"fragment\": " << total.fragment_ms / frames
+                 << ", \"resolve\": " << total.resolve_ms / frames << "}, \"triangles_per_s\": "
+                 << total.submitted / seconds << ", \"fragments_per_s\": " << total.shaded / seconds
+                 << ", \"culled\": " << total.culled / frames << ", \"shaded_per_frame\": " << total.shaded / frames
+                 << "}";
+            first = false;
+        }
+    }
+    json << "\n  ]\n}\n";
+    std::cout << "Wrote " << json_path << "\n";
+    return 0;
+}
+
 int main(int argc, const char** argv)
 {
     float angle = 0;
     bool command_line = false;
     std::string filename = "output.png";
 
-    if (argc == 2)
+    rst::rasterizer r(700, 700);
+
+    Eigen::Vector3f eye_pos = {0,0,5};
+
+    // benchmark [帧数] [开关...]：不开窗口，画两个三角形和一个合成的球，结果写成 JSON（json=<路径>，默认 benchmark.json）
+    bool benchmark = argc >= 2 && std::string(argv[1]) == "benchmark";
+    int frames = 20;
+    std::string json_path = "benchmark.json";
+    if (benchmark && argc >= 3)
+        frames = std::stoi(argv[2]);
+
+    if (argc >= 2)
     {
         command_line = true;
         filename = std::string(argv[1]);
     }
-
-    rst::rasterizer r(700, 700);
-
-    Eigen::Vector3f eye_pos = {0,0,5};
+    // 后面的参数是开关：cull 打开背面剔除，eye=<z> 把相机放到 (0, 0, z)，msaa=<n> 每个像素 n 个采样点
+    for (int i = benchmark ? 3 : 2; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "cull")
+            r.set_backface_culling(true);
+        else if (std::string(argv[i]).rfind("msaa=", 0) == 0)
+            r.set_msaa(std::stoi(std::string(argv[i]).substr(5)));
+        else if (std::string(argv[i]).rfind("eye=", 0) == 0)
+            eye_pos.z() = std::stof(std::string(argv[i]).substr(4));
+        else if (std::string(argv[i]).rfind("json=", 0) == 0)
+            json_path = std::string(argv[i]).substr(5);
+    }
 
 
     std::vector<Eigen::Vector3f> pos
@@ -108,6 +228,24 @@ int main(int argc, const char** argv)
                     {185.0, 217.0, 238.0}
             };
 
+    if (benchmark)
+    {
+        std::vector<bench_scene> scenes(2);
+        scenes[0].name = "triangles";
+        scenes[0].positions = pos;
+        scenes[0].colors = cols;
+        scenes[0].indices = ind;
+        scenes[1].name = "sphere";
+        make_sphere(1.5f, 256, 512, scenes[1]);
+        // 球也放在两个三角形中间的深度
+        for (auto& p : scenes[1].positions)
+            p.z() -= 3.5f;
+        r.set_view(get_view_matrix(eye_pos));
+        r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
+        r.set_near_plane(0.1);
+        return run_benchmark(r, scenes, frames, json_path);
+    }
+
     auto pos_id = r.load_positions(pos);
     auto ind_id = r.load_indices(ind);
     auto col_id = r.load_colors(cols);
@@ -122,6 +260,7 @@ int main(int argc, const char** argv)
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
+        r.set_near_plane(0.1);
 
         // r.draw_test();
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
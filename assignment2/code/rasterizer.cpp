@@ -4,6 +4,8 @@
 //
 
 #include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include <vector>
 #include "rasterizer.hpp"
 #include <opencv2/opencv.hpp>
@@ -39,6 +41,19 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
+// 保护带（像素）：屏幕坐标在这个范围内的三角形不对屏幕边缘裁剪，包围盒夹到屏幕上就够了；
+// 超出的才对保护带的边裁剪，float 的屏幕坐标在这个范围里还有 1/128 像素的精度
+static constexpr float guard_band = 1 << 16;
+
+// 齐次空间的裁剪面，clip_code 里一个面一位
+static constexpr int clip_near = 1;
+static constexpr int clip_left = 2;
+static constexpr int clip_right = 4;
+static constexpr int clip_bottom = 8;
+static constexpr int clip_top = 16;
+// 三角形每对一个面裁剪最多多一个顶点
+static constexpr int max_clip_vertices = 3 + 5;
+
 /**
  * @brief cross product of v1v2 and v2v3
  * 
@@ -275,73 +290,262 @@ void rst::rasterizer::draw_test()
     std::cout << "cp inside:" << cp1 << " " << cp2 << " " << cp3 << " " <<  inside1 << "\n";
 }
 
+/**
+ * @brief 
+ * 整个物体的包围盒在视锥外面就什么都不画；
+ * 三个顶点都在同一个裁剪面外面的三角形丢掉，跨近平面（或超出保护带）的在齐次空间裁剪成几个三角形，
+ * 可选的背面剔除，剩下的做透视除法和视口变换之后光栅化
+ */
 void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
 {
     auto& buf = pos_buf[pos_buffer.pos_id];
     auto& ind = ind_buf[ind_buffer.ind_id];
     auto& col = col_buf[col_buffer.col_id];
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+    using clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(clock::now() - since).count();
+    };
+    stats = draw_stats();
+    stats.submitted = ind.size();
+    auto start = clock::now();
 
     Eigen::Matrix4f mvp = projection * view * model;
+    // 相机空间里 (0, 0, -1) 这个点投影之后的 w
+    w_sign = projection(3, 3) - projection(3, 2) >= 0 ? 1 : -1;
+    float guard_x = guard_band / width, guard_y = guard_band / height;
 
+    bool need_clip = true;
+    if (!object_visible(mvp, buf, need_clip))
+    {
+        stats.culled = stats.submitted;
+        stats.vertex_ms = elapsed_ms(start);
+        return;
+    }
+
+    // 先把所有三角形变换、裁剪成屏幕空间的三角形，再统一光栅化，两个阶段分开计时
+    screen_triangles.clear();
     for (auto& i : ind)
     {
-        Triangle t;
-        Eigen::Vector4f v[] = {
-                mvp * to_vec4(buf[i[0]], 1.0f),
-                mvp * to_vec4(buf[i[1]], 1.0f),
-                mvp * to_vec4(buf[i[2]], 1.0f)
-        };
-        //Homogeneous division
-        for (auto& vec : v) {
-            vec /= vec.w();
+        clip_vertex poly[max_clip_vertices];
+        int outside_all = ~0, outside_any = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            poly[k].pos = mvp * to_vec4(buf[i[k]], 1.0f);
+            poly[k].color = col[i[k]];
+            // 整个物体都在近平面前面、保护带里面时不用逐个顶点判断
+            int code = need_clip ? clip_code(poly[k].pos, guard_x, guard_y) : 0;
+            outside_all &= code;
+            outside_any |= code;
         }
-        //Viewport transformation
-        for (auto & vert : v)
+        if (outside_all)
         {
-            std::cout << "before vert.x:" << vert.x() << "\n";
-            // std::cout << "before vert.y:" << vert.y() << "\n";
-            // std::cout << "before vert.z:" << vert.z() << "\n";
-            // x, y, z经过mvp处理之后是[-1, 1]的范围
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
-            std::cout << "after vert.x:" << vert.x() << "\n";
-            // std::cout << "after vert.y:" << vert.y() << "\n";
-            // std::cout << "after vert.z:" << vert.z() << "\n"; 
+            ++stats.culled;
+            continue;
         }
+        int n = outside_any ? clip_polygon(poly, 3, outside_any) : 3;
+        if (n < 3)
+        {
+            ++stats.culled;
+            continue;
+        }
+
+        Eigen::Vector3f v[max_clip_vertices];
+        for (int k = 0; k < n; ++k)
+            v[k] = viewport(poly[k].pos);
 
-        for (int i = 0; i < 3; ++i)
+        if (cull_backfaces)
         {
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
+            // 屏幕上逆时针（面积为正）的是正面
+            float area = 0;
+            for (int k = 0; k < n; ++k)
+                area += v[k].x() * v[(k + 1) % n].y() - v[k].y() * v[(k + 1) % n].x();
+            if (area <= 0)
+            {
+                ++stats.culled;
+                continue;
+            }
         }
 
-        auto col_x = col[i[0]];
-        auto col_y = col[i[1]];
-        auto col_z = col[i[2]];
+        // 裁剪后的凸多边形扇形三角化
+        for (int k = 1; k + 1 < n; ++k)
+        {
+            Triangle t;
+            int corner[3] = {0, k, k + 1};
+            for (int j = 0; j < 3; ++j)
+            {
+                t.setVertex(j, v[corner[j]]);
+                auto& c = poly[corner[j]].color;
+                t.setColor(j, c[0], c[1], c[2]);
+            }
 
-        t.setColor(0, col_x[0], col_x[1], col_x[2]);
-        t.setColor(1, col_y[0], col_y[1], col_y[2]);
-        t.setColor(2, col_z[0], col_z[1], col_z[2]);
+            screen_triangles.push_back(t);
+        }
+    }
+    stats.vertex_ms = elapsed_ms(start);
 
+    start = clock::now();
+    for (auto& t : screen_triangles)
+    {
         rasterize_triangle(t);
         // 单线的渲染是对的
         // rasterize_wireframe(t);
     }
-    rasterize_super_sample();
+    stats.raster_ms = elapsed_ms(start);
+
+    start = clock::now();
+    resolve_edge_pixels();
+    stats.resolve_ms = elapsed_ms(start);
 }
 
-void rst::rasterizer::rasterize_super_sample()
+// 透视除法 + 视口变换，x, y, z经过mvp处理之后是[-1, 1]的范围
+Eigen::Vector3f rst::rasterizer::viewport(Eigen::Vector4f vert) const
 {
-    for(int x = 0; x < width; x++) {
-        for(int y = 0; y < height; y++) {
-            int index = get_index(x, y);
-            int sample_index = index * 4;
-            frame_buf[index] = (sample_frame_buf[sample_index] + sample_frame_buf[sample_index + 1] + sample_frame_buf[sample_index + 2] + sample_frame_buf[sample_index + 3]) / 4;
+    float f1 = (50 - 0.1) / 2.0;
+    float f2 = (50 + 0.1) / 2.0;
+
+    //Homogeneous division
+    vert /= vert.w();
+    //Viewport transformation
+    vert.x() = 0.5*width*(vert.x()+1.0);
+    vert.y() = 0.5*height*(vert.y()+1.0);
+    vert.z() = vert.z() * f1 + f2;
+    return vert.head<3>();
+}
+
+/**
+ * @brief 裁剪空间的点到某个裁剪面的有向距离，>= 0 是在里面
+ * 近平面是相机空间的深度 w_sign * w >= near_plane；
+ * 左右上下是 |x| <= extent_x * |w|、|y| <= extent_y * |w|，extent 是 1 时就是屏幕的边，取保护带时更宽
+ */
+float rst::rasterizer::clip_distance(const Eigen::Vector4f& v, int plane, float extent_x, float extent_y) const
+{
+    float w = w_sign * v.w();
+    switch (plane)
+    {
+    case clip_near:
+        return w - near_plane;
+    case clip_left:
+        return extent_x * w + v.x();
+    case clip_right:
+        return extent_x * w - v.x();
+    case clip_bottom:
+        return extent_y * w + v.y();
+    default:
+        return extent_y * w - v.y();
+    }
+}
+
+int rst::rasterizer::clip_code(const Eigen::Vector4f& v, float extent_x, float extent_y) const
+{
+    int code = 0;
+    for (int plane = clip_near; plane <= clip_top; plane <<= 1)
+        // 写成 !(... >= 0) 顺便把 NaN 当成在外面
+        if (!(clip_distance(v, plane, extent_x, extent_y) >= 0))
+            code |= plane;
+    return code;
+}
+
+/**
+ * @brief Sutherland-Hodgman：poly 里的凸多边形依次对 planes 里的每个面裁剪，结果写回 poly
+ * @return 裁剪后的顶点数，小于 3 表示整个被裁掉了
+ */
+int rst::rasterizer::clip_polygon(clip_vertex* poly, int n, int planes) const
+{
+    float guard_x = guard_band / width, guard_y = guard_band / height;
+    clip_vertex out[max_clip_vertices];
+    for (int plane = clip_near; plane <= clip_top; plane <<= 1)
+    {
+        if (!(planes & plane))
+            continue;
+        int m = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            const clip_vertex& a = poly[k];
+            const clip_vertex& b = poly[(k + 1) % n];
+            float da = clip_distance(a.pos, plane, guard_x, guard_y);
+            float db = clip_distance(b.pos, plane, guard_x, guard_y);
+            if (da >= 0)
+                out[m++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                float t = da / (da - db);
+                out[m].pos = a.pos + (b.pos - a.pos) * t;
+                // Triangle::setColor 遇到 [0, 255] 以外的值会直接退出，舍入误差也不能超出两端
+                out[m].color = (a.color + (b.color - a.color) * t).cwiseMax(a.color.cwiseMin(b.color)).cwiseMin(a.color.cwiseMax(b.color));
+                ++m;
+            }
+        }
+        n = m;
+        if (n < 3)
+            return n;
+        std::copy(out, out + n, poly);
+    }
+    return n;
+}
+
+/**
+ * @brief 整体视锥剔除：物体包围盒的 8 个角变换到裁剪空间，全部在同一个面（近平面或屏幕的某条边）外面，
+ * 物体就整个看不见。只会漏剔，不会错剔
+ * @param need_clip 8 个角都在近平面前面、保护带里面时为 false，里面的三角形都不用裁剪
+ */
+bool rst::rasterizer::object_visible(const Eigen::Matrix4f& mvp, const std::vector<Eigen::Vector3f>& positions, bool& need_clip) const
+{
+    need_clip = true;
+    Eigen::AlignedBox3f bounds;
+    for (auto& p : positions)
+        bounds.extend(p);
+    if (bounds.isEmpty())
+        return true;
+    float guard_x = guard_band / width, guard_y = guard_band / height;
+    int outside_all = ~0, outside_guard = 0;
+    for (int k = 0; k < 8; ++k)
+    {
+        Eigen::Vector4f clip = mvp * to_vec4(bounds.corner((Eigen::AlignedBox3f::CornerType)k), 1.0f);
+        outside_all &= clip_code(clip, 1, 1);
+        outside_guard |= clip_code(clip, guard_x, guard_y);
+    }
+    need_clip = outside_guard != 0;
+    return outside_all == 0;
+}
+
+/**
+ * @brief MSAA 的 resolve：只有部分覆盖过的边缘像素有每个采样点的颜色，求平均写回 frame_buf；
+ * 其他像素整个被一个三角形覆盖，颜色本来就直接写在 frame_buf 里
+ */
+void rst::rasterizer::resolve_edge_pixels()
+{
+    for (int index : edge_pixels) {
+        const Eigen::Vector3f* colors = &edge_colors[edge_index[index]];
+        Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+        for (int s = 0; s < num_samples; s++) {
+            sum += colors[s];
+        }
+        frame_buf[index] = sum / num_samples;
+    }
+}
+
+/**
+ * @brief 把颜色写到 mask 里的采样点上
+ * 采样点全覆盖的像素只写一份颜色；第一次部分覆盖时才给这个像素分一块每个采样点的颜色，
+ * 用像素原来的颜色填满，之后按 mask 写，这块一直用到下次 clear
+ */
+void rst::rasterizer::write_samples(int index, uint32_t mask, const Eigen::Vector3f& color)
+{
+    int block = edge_index[index];
+    if (block < 0) {
+        if (mask == (1u << num_samples) - 1) {
+            frame_buf[index] = color;
+            return;
+        }
+        block = edge_colors.size();
+        edge_colors.resize(block + num_samples, frame_buf[index]);
+        edge_index[index] = block;
+        edge_pixels.push_back(index);
+    }
+    for (int s = 0; s < num_samples; s++) {
+        if (mask >> s & 1) {
+            edge_colors[block + s] = color;
         }
     }
 }
@@ -356,99 +560,84 @@ void rst::rasterizer::rasterize_wireframe(const Triangle& t)
 /**
  * 
  * @brief Screen space rasterization
- * super-sampling
- * 把一个像素当做2x2的格子，然后计算里面有多少个小格子在三角形里面，计算出比例作为颜色的深浅比例
+ * MSAA：每个像素 num_samples 个采样点，每个采样点各自做覆盖和深度测试，得到这个三角形在这个像素上的覆盖掩码；
+ * 颜色每个像素只算一次，写到通过测试的采样点上。深度按采样点存，颜色只有边缘像素才按采样点存
  * @param t 
  */
 void rst::rasterizer::rasterize_triangle(const Triangle& t) {
     auto v = t.toVector4(); 
-    // std::cout << "v0:" << v.at(0).x() << "," << v.at(0).y() << "," << v.at(0).z() << std::endl;
-    // std::cout << "v1:" << v.at(1).x() << "," << v.at(1).y() << "," << v.at(1).z() << std::endl;
-    // std::cout << "v2:" << v.at(2).x() << "," << v.at(2).y() << "," << v.at(2).z() << std::endl;
 
     // TODO : Find out the bounding box of current triangle.    
     float x_arr[] = {v.at(0).x(), v.at(1).x(), v.at(2).x()};
     float y_arr[] = {v.at(0).y(), v.at(1).y(), v.at(2).y()};
-    int min_x = std::floor(static_cast<double>(*std::min_element(std::begin(x_arr), std::end(x_arr))));
-    int max_x = std::ceil(static_cast<double>(*std::max_element(std::begin(x_arr), std::end(x_arr))));
-    int min_y = std::floor(static_cast<double>(*std::min_element(std::begin(y_arr), std::end(y_arr))));
-    int max_y = std::ceil(static_cast<double>(*std::max_element(std::begin(y_arr), std::end(y_arr))));
-
-    // std::cout << "min_x:" << min_x << std::endl;
-    // std::cout << "max_x:" << max_x << std::endl;
-    // std::cout << "min_y:" << min_y << std::endl;
-    // std::cout << "max_y:" << max_y << std::endl;
+    // 包围盒夹到屏幕内，屏幕外的部分不遍历，也不会越界写缓冲
+    int min_x = std::max(0, (int)std::floor(static_cast<double>(*std::min_element(std::begin(x_arr), std::end(x_arr)))));
+    int max_x = std::min(width - 1, (int)std::ceil(static_cast<double>(*std::max_element(std::begin(x_arr), std::end(x_arr)))));
+    int min_y = std::max(0, (int)std::floor(static_cast<double>(*std::min_element(std::begin(y_arr), std::end(y_arr)))));
+    int max_y = std::min(height - 1, (int)std::ceil(static_cast<double>(*std::max_element(std::begin(y_arr), std::end(y_arr)))));
 
     std::array<Eigen::Vector3f, 3> res;
     std::transform(std::begin(v), std::end(v), res.begin(), [](auto& vec) { return Eigen::Vector3f(vec.x(), vec.y(), vec.z()); });
 
+    // 这次的作业每个三角形只有一种颜色，相当于每个像素着色一次
+    Eigen::Vector3f color = t.getColor();
+
     // iterate through the pixel and find if the current pixel is inside the triangle
     for( int x = min_x; x<=max_x; x++ ) {
         for( int y = min_y; y<=max_y; y++ ) {
-            // std::cout << "x:" << x << " y:" << y << std::endl;
-            // 这里x和y代表的是左下方的坐标，其实中心因为是在x+0.5和y+0.5
-            // 黑边的理由，这里的判断is_inside的颗粒度是一个像素，但是这里会有很多in一个小格的点，但是一个像素是被判定为out的情况，所以会有黑边
-            // bool is_inside = insideTriangle(1.0f * (x + 0.5f), 1.0f * (y + 0.5f), res.data());
+            // 这里x和y代表的是左下方的坐标，像素中心在(x+0.5, y+0.5)，采样点的位置相对于中心
             int index = get_index(x, y);
-            Eigen::Vector3f color = t.getColor();
-            int sample_index = 0;
-            float z_interpolated = 0.0f, old_z;
-            if( insideTriangle(x + 0.25f, y + 0.25f, res.data()) ){
-                z_interpolated = get_z_interpolated(x + 0.25f, y + 0.25f, t);
-                sample_index = index * 4;
-                old_z = sample_depth_buf[sample_index];
-                if( z_interpolated < old_z ){
-                    sample_depth_buf[sample_index] = z_interpolated;
-                    set_sample_pixel(sample_index, color);
+            float* depth = &sample_depth_buf[index * num_samples];
+            uint32_t mask = 0;
+            for (int s = 0; s < num_samples; s++) {
+                float sx = x + 0.5f + sample_offsets[s].x();
+                float sy = y + 0.5f + sample_offsets[s].y();
+                if (!insideTriangle(sx, sy, res.data())) {
+                    continue;
                 }
-            }            
-            if( insideTriangle(x + 0.75f, y + 0.25f, res.data()) ){
-                z_interpolated = get_z_interpolated(x + 0.75f, y + 0.25f, t);
-                sample_index = index * 4 + 1;
-                old_z = sample_depth_buf[sample_index];
-                if( z_interpolated < old_z ){
-                    sample_depth_buf[sample_index] = z_interpolated;
-                    set_sample_pixel(sample_index, color);
-                }
-            }    
-            if( insideTriangle(x + 0.25f, y + 0.75f, res.data()) ){
-                z_interpolated = get_z_interpolated(x + 0.25f, y + 0.75f, t);
-                sample_index = index * 4 + 2;
-                old_z = sample_depth_buf[sample_index];
-                if( z_interpolated < old_z ){
-                    sample_depth_buf[sample_index] = z_interpolated;
-                    set_sample_pixel(sample_index, color);
+                float z_interpolated = get_z_interpolated(sx, sy, t);
+                // 当前z的比旧的小，需要进行更新
+                if (z_interpolated < depth[s]) {
+                    depth[s] = z_interpolated;
+                    mask |= 1u << s;
                 }
             }
-            if( insideTriangle(x + 0.75f, y + 0.75f, res.data()) ){
-                z_interpolated = get_z_interpolated(x + 0.75f, y + 0.75f, t);
-                sample_index = index * 4 + 3;
-                old_z = sample_depth_buf[sample_index];
-                if( z_interpolated < old_z ){
-                    sample_depth_buf[sample_index] = z_interpolated;
-                    set_sample_pixel(sample_index, color);
-                }
+            if (mask) {
+                ++stats.shaded;
+                write_samples(index, mask, color);
             }
-            // std::cout << "is_inside:" << is_inside << " " << x << " " << y << std::endl;
-            // if( is_inside ){                
-            //     float z_interpolated = get_z_interpolated(1.0f * x, 1.0f * y, t);
-            //     int index = get_index(x, y);             
-            //     float old_z = depth_buf[index];
-            //     // 当前z的比旧的小，需要进行更新
-            //     if( z_interpolated < old_z ){
-            //         depth_buf[index] = z_interpolated;
-            //         Eigen::Vector3f point = Eigen::Vector3f(x, y, 1.0f);
-            //         // set_pixel(point, t.getColor());
-            //         Eigen::Vector3f color = t.getColor();
-            //         float rate = getColorRate(1.0f * x, 1.0f * y, res.data());
-            //         Eigen::Vector3f newColor = Eigen::Vector3f(static_cast<int>(color.x()*rate), static_cast<int>(color.y()*rate), static_cast<int>(color.z()*rate));
-            //         set_pixel(point, newColor);
-            //     }
-            // }
         }
     }
 }
 
+/**
+ * @brief 设置每个像素的采样点数，可以是 1/2/4/8/16
+ * 采样点位置用 D3D 的标准样式（1/16 像素为单位，相对像素中心），不是规则网格，
+ * 接近水平/竖直的边也能分出 num_samples 级的覆盖率。会清空颜色和深度
+ */
+void rst::rasterizer::set_msaa(int samples)
+{
+    static const std::map<int, std::vector<Eigen::Vector2f>> patterns = {
+        {1, {{0, 0}}},
+        {2, {{4, 4}, {-4, -4}}},
+        {4, {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}}},
+        {8, {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}}},
+        {16, {{1, 1}, {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5}, {5, 3}, {3, -5},
+              {-2, 6}, {0, -7}, {-4, -6}, {-6, 4}, {-8, 0}, {7, -4}, {6, 7}, {-7, -8}}},
+    };
+    auto it = patterns.find(samples);
+    if (it == patterns.end()) {
+        throw std::runtime_error("MSAA sample count must be 1, 2, 4, 8 or 16");
+    }
+    num_samples = samples;
+    sample_offsets.clear();
+    for (auto& offset : it->second) {
+        sample_offsets.push_back(offset / 16.0f);
+    }
+    sample_depth_buf.resize(num_samples * width * height);
+    clear(rst::Buffers::Color | rst::Buffers::Depth);
+}
+
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
 {
     model = m;
@@ -469,7 +658,9 @@ void rst::rasterizer::clear(rst::Buffers buff)
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
         std::fill(frame_buf.begin(), frame_buf.end(), Eigen::Vector3f{0, 0, 0});
-        std::fill(sample_frame_buf.begin(), sample_frame_buf.end(), Eigen::Vector3f{0, 0, 0});
+        std::fill(edge_index.begin(), edge_index.end(), -1);
+        edge_colors.clear();
+        edge_pixels.clear();
     }
     // 这里初始化的时候设定默认深度是infinity，也就是说越小的z离相机越近，但是相机是往-z的方向看的，所以需要特殊处理
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
@@ -482,9 +673,9 @@ void rst::rasterizer::clear(rst::Buffers buff)
 rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 {
     frame_buf.resize(w * h);
-    sample_frame_buf.resize(4 * w * h);
     depth_buf.resize(w * h);
-    sample_depth_buf.resize(4 * w * h);
+    edge_index.resize(w * h, -1);
+    set_msaa(4);
 }
 
 int rst::rasterizer::get_index(int x, int y)
@@ -501,15 +692,12 @@ int rst::rasterizer::get_index(int x, int y)
 void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color)
 {
     //old index: auto ind = point.y() + point.x() * width;
+    if (point.x() < 0 || point.x() >= width || point.y() < 0 || point.y() >= height)
+        return;
     auto ind = (height-1-point.y())*width + point.x();
     // std::cout << "ind:" << point.y() << " " << point.x() << " " << ind << std::endl;
     frame_buf[ind] = color;
 
 }
 
-void rst::rasterizer::set_sample_pixel(int sample_index, const Eigen::Vector3f& color)
-{
-    sample_frame_buf[sample_index] = color;
-}
-
 // clang-format on
\ No newline at end of file
@@ -6,6 +6,10 @@
 
 #include <eigen3/Eigen/Eigen>
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <vector>
 #include "global.hpp"
 #include "Triangle.hpp"
 using namespace Eigen;
@@ -54,6 +58,33 @@ namespace rst
         int col_id = 0;
     };
 
+    // 最近一次 draw 的统计：submitted 是提交的三角形，culled 是整体剔除、完全在裁剪面外面、背面剔除丢掉的，
+    // shaded 是写了颜色的像素数（每个像素每个三角形算一次，和采样点数无关）。
+    // 各阶段耗时（毫秒）：vertex 是变换 + 裁剪 + 视口变换，raster 是覆盖和深度测试，颜色每个三角形只有一种，
+    // 写颜色算在 raster 里，fragment 一直是 0；resolve 是 MSAA 边缘像素求平均
+    struct draw_stats
+    {
+        long long submitted = 0;
+        long long culled = 0;
+        long long shaded = 0;
+        double vertex_ms = 0;
+        double raster_ms = 0;
+        double fragment_ms = 0;
+        double resolve_ms = 0;
+
+        draw_stats& operator+=(const draw_stats& o)
+        {
+            submitted += o.submitted;
+            culled += o.culled;
+            shaded += o.shaded;
+            vertex_ms += o.vertex_ms;
+            raster_ms += o.raster_ms;
+            fragment_ms += o.fragment_ms;
+            resolve_ms += o.resolve_ms;
+            return *this;
+        }
+    };
+
     class rasterizer
     {
     public:
@@ -67,15 +98,25 @@ namespace rst
         void set_projection(const Eigen::Matrix4f& p);
 
         void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
-        void set_sample_pixel(int sample_index, const Eigen::Vector3f& color);
 
         void clear(Buffers buff);
 
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
         void draw_test();
 
+        // MSAA 每个像素的采样点数：1/2/4/8/16，默认 4
+        void set_msaa(int samples);
+
+        // 近平面到相机的距离，和投影矩阵的 zNear 一致。跨近平面的三角形在齐次空间裁剪，
+        // 屏幕边缘只靠保护带 + 包围盒夹到屏幕内，不做裁剪
+        void set_near_plane(float z_near) { near_plane = z_near; }
+        // 背面剔除：正面是逆时针，屏幕上顺时针的三角形直接丢掉
+        void set_backface_culling(bool on) { cull_backfaces = on; }
+
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
 
+        const draw_stats& last_stats() const { return stats; }
+
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
@@ -83,7 +124,22 @@ namespace rst
         
         void rasterize_wireframe(const Triangle& t);
 
-        void rasterize_super_sample();
+        void resolve_edge_pixels();
+
+        void write_samples(int index, uint32_t mask, const Eigen::Vector3f& color);
+
+        // 裁剪空间的顶点，裁剪时位置和颜色一起沿边插值
+        struct clip_vertex
+        {
+            Eigen::Vector4f pos;
+            Eigen::Vector3f color;
+        };
+
+        Eigen::Vector3f viewport(Eigen::Vector4f vert) const;
+        float clip_distance(const Eigen::Vector4f& v, int plane, float extent_x, float extent_y) const;
+        int clip_code(const Eigen::Vector4f& v, float extent_x, float extent_y) const;
+        int clip_polygon(clip_vertex* poly, int n, int planes) const;
+        bool object_visible(const Eigen::Matrix4f& mvp, const std::vector<Eigen::Vector3f>& positions, bool& need_clip) const;
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -97,13 +153,29 @@ namespace rst
         std::map<int, std::vector<Eigen::Vector3f>> col_buf;
 
         std::vector<Eigen::Vector3f> frame_buf;
-        std::vector<Eigen::Vector3f> sample_frame_buf;
         std::vector<float> depth_buf;
+        // MSAA：深度每个采样点一份；颜色只有部分覆盖过的边缘像素才每个采样点一份，
+        // edge_index 是这个像素在 edge_colors 里的起点（-1 表示不是边缘像素，颜色就在 frame_buf），
+        // edge_pixels 是所有边缘像素，resolve 只处理它们
+        int num_samples = 4;
+        std::vector<Eigen::Vector2f> sample_offsets;
         std::vector<float> sample_depth_buf;
+        std::vector<int> edge_index;
+        std::vector<Eigen::Vector3f> edge_colors;
+        std::vector<int> edge_pixels;
         int get_index(int x, int y);
 
         int width, height;
 
+        float near_plane = 0.1f;
+        bool cull_backfaces = false;
+        // 可见的点投影之后 w 的符号。作业里的投影矩阵 w = z，相机看 -z 方向，所以 w 是负的
+        float w_sign = 1;
+
+        // 顶点阶段输出的屏幕空间三角形，光栅化阶段再一个个画；每次 draw 复用
+        std::vector<Triangle> screen_triangles;
+        draw_stats stats;
+
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
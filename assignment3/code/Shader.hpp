@@ -22,7 +22,12 @@ struct fragment_shader_payload
     Eigen::Vector3f view_pos;
     Eigen::Vector3f color;
     Eigen::Vector3f normal;
+    // 切线：顶点阶段按作业里 TBN 的公式由顶点法线算好再插值，没有归一化（凹凸着色器用）
+    Eigen::Vector3f tangent = Eigen::Vector3f::UnitX();
     Eigen::Vector2f tex_coords;
+    // 纹理坐标对屏幕 x、y 的偏导（2x2 quad 里相邻像素的差），纹理过滤选 mip 用
+    Eigen::Vector2f duv_dx = Eigen::Vector2f::Zero();
+    Eigen::Vector2f duv_dy = Eigen::Vector2f::Zero();
     Texture* texture;
 };
 
@@ -2,3 +2,110 @@
 // Created by LEI XU on 4/27/19.
 //
 
+#include "Texture.hpp"
+
+namespace
+{
+uint32_t pack(const Eigen::Vector3f& c)
+{
+    auto channel = [](float x) { return (uint32_t)std::clamp((int)std::lround(x), 0, 255); };
+    return channel(c.x()) | (channel(c.y()) << 8) | (channel(c.z()) << 16) | (255u << 24);
+}
+}
+
+Texture::Texture(const std::string &name)
+{
+    cv::Mat image_data = cv::imread(name);
+    cv::cvtColor(image_data, image_data, cv::COLOR_RGB2BGR);
+    width = image_data.cols;
+    height = image_data.rows;
+
+    // 每层先用 float 算出来再打包，下一层从这一层的 float 结果 2x2 平均，避免 8 位舍入一层层累积
+    std::vector<Eigen::Vector3f> current(width * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            auto color = image_data.at<cv::Vec3b>(y, x);
+            current[y * width + x] = Eigen::Vector3f(color[0], color[1], color[2]);
+        }
+
+    // 高度取颜色的模长；u 往右一个纹素是下一列，v 往上一个纹素是上一行（纹素的行从上往下存），出界按 wrap 处理
+    height_gradient.resize(width * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float h = current[y * width + x].norm();
+            float right = current[y * width + address(x + 1, width)].norm();
+            float up = current[address(y - 1, height) * width + x].norm();
+            height_gradient[y * width + x] = Eigen::Vector3f(h, right - h, up - h);
+        }
+
+    int w = width, h = height;
+    while (true)
+    {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.tiles_x = (w + 7) / 8;
+        level.texels.assign((size_t)level.tiles_x * ((h + 7) / 8) * 64, 0);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                level.texels[level.index(x, y)] = pack(current[y * w + x]);
+        mips.push_back(std::move(level));
+        if (w == 1 && h == 1)
+            break;
+
+        // 边长向上取半，每个纹素都参与下一层；奇数边长时最后一列/行被夹到自己身上用两次，是个近似的 box filter
+        int nw = (w + 1) / 2, nh = (h + 1) / 2;
+        std::vector<Eigen::Vector3f> next(nw * nh);
+        for (int y = 0; y < nh; ++y)
+            for (int x = 0; x < nw; ++x)
+            {
+                int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                next[y * nw + x] = (current[y0 * w + x0] + current[y0 * w + x1] + current[y1 * w + x0] +
+                                    current[y1 * w + x1]) * 0.25f;
+            }
+        current.swap(next);
+        w = nw;
+        h = nh;
+    }
+}
+
+Eigen::Vector3f Texture::sampleLevel(float u, float v, float lod) const
+{
+    int last = mips.size() - 1;
+    lod = std::clamp(lod, 0.0f, (float)last);
+    int l0 = (int)lod;
+    float f = lod - l0;
+    if (f == 0 || l0 == last)
+        return bilinear(mips[l0], u, v);
+    return bilinear(mips[l0], u, v) * (1 - f) + bilinear(mips[l0 + 1], u, v) * f;
+}
+
+Eigen::Vector3f Texture::sample(float u, float v, const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+{
+    // 换算成第 0 层纹素单位下，一个像素在纹理上的两条轴
+    float lx = Eigen::Vector2f(duv_dx.x() * width, duv_dx.y() * height).norm();
+    float ly = Eigen::Vector2f(duv_dy.x() * width, duv_dy.y() * height).norm();
+    float major = std::max(lx, ly), minor = std::min(lx, ly);
+    if (!(major > 0))
+        return getColorBilinear(u, v);
+
+    // 样本数取长短轴之比，用足了以后剩下的各向异性交给更模糊的层
+    int n = 1;
+    if (max_anisotropy > 1)
+        n = std::clamp((int)std::ceil(major / std::max(minor, 1e-6f)), 1, max_anisotropy);
+    float lod = std::log2(major / n);
+    if (n == 1)
+        return sampleLevel(u, v, lod);
+
+    const Eigen::Vector2f& axis = lx >= ly ? duv_dx : duv_dy;
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    for (int i = 0; i < n; ++i)
+    {
+        float t = (i + 0.5f) / n - 0.5f;
+        sum += sampleLevel(u + axis.x() * t, v + axis.y() * t, lod);
+    }
+    return sum / n;
+}
@@ -8,6 +8,10 @@
 #include "Texture.hpp"
 #include "OBJ_Loader.h"
 #include <math.h> 
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <array>
 
 Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
 {
@@ -115,7 +119,9 @@ Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
         // std::cout << payload.tex_coords << " " << payload.tex_coords[0] << " " << payload.tex_coords[1] << " " << std::endl;
         // return_color = payload.texture->getColor(payload.tex_coords[0], payload.tex_coords[1]);
         // 测试双线性插值进行纹理采样
-        return_color = payload.texture->getColorBilinear(payload.tex_coords[0], payload.tex_coords[1]);
+        // return_color = payload.texture->getColorBilinear(payload.tex_coords[0], payload.tex_coords[1]);
+        // 用 quad 给的屏幕空间导数选 mip，三线性 + 各向异性过滤，缩小时不再走样
+        return_color = payload.texture->sample(payload.tex_coords[0], payload.tex_coords[1], payload.duv_dx, payload.duv_dy);
         // std::cout << return_color << std::endl;
     }
     Eigen::Vector3f texture_color;
@@ -229,7 +235,8 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payl
     auto l1 = light{{20, 20, 20}, {500, 500, 500}};
     auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
 
-    std::vector<light> lights = {l1, l2};
+    // 光源是固定的两个，用数组，每个片元不用在堆上分配
+    const light lights[] = {l1, l2};
     Eigen::Vector3f amb_light_intensity{10, 10, 10};
     Eigen::Vector3f eye_pos{0, 0, 10};
 
@@ -252,6 +259,7 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payl
     // Position p = p + kn * n * h(u,v)
     // Normal n = normalize(TBN * ln)
     Eigen::Vector3f n = normal;
+    // t 仍按片元法线现算，不用插值的 payload.tangent：位移后高光(p=150)会把两者的微小差别放大成可见的色差
     float x = normal.x(), y = normal.y(), z = normal.z();
     // sqrt(x*x+z*z)
     float s = sqrt(x * x + z * z);
@@ -265,13 +273,11 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payl
             t.z(), b.z(), n.z();
     // payload.texture->getColor(payload.tex_coords[0], payload.tex_coords[1])
     // bump mapping 部分的 h(u,v)=texture_color(u,v).norm, 其中 u,v 是 tex_coords, w,h 是 texture 的宽度与高度
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float w = payload.texture->width;
-    float h = payload.texture->height;
-    float huv = payload.texture->getColor(u, v).norm();
-    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - huv);
-    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - huv);
+    // h(u,v) 和两个差分在纹理加载时就算好了，取一次
+    Eigen::Vector3f height = payload.texture->getHeightGradient(payload.tex_coords.x(), payload.tex_coords.y());
+    float huv = height.x();
+    float dU = kh * kn * height.y();
+    float dV = kh * kn * height.z();
 
     Eigen::Vector3f ln = Eigen::Vector3f(-dU, -dV, 1.0f);
     point = point + kn * n * huv;
@@ -286,15 +292,20 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payl
     {
         // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
         // components are. Then, accumulate that result on the *result_color* object.
-        Eigen::Vector3f light_vec = (light.position - point).normalized();
-        float r = (light.position - point).norm();
-        Eigen::Vector3f light_power = (light.intensity / std::pow(r, 2.0f));
+        // 距离平方和方向共用一次开方
+        Eigen::Vector3f to_light = light.position - point;
+        float r2 = to_light.squaredNorm();
+        Eigen::Vector3f light_vec = to_light / std::sqrt(r2);
+        Eigen::Vector3f light_power = light.intensity / r2;
         // 漫反射
         Eigen::Vector3f ld = kd.cwiseProduct(light_power) * std::max(0.0f, light_vec.dot(normal));
         // 镜面反射
-        // 半程向量
+        // 半程向量；背对高光时 pow 的结果是 0，不用算
         Eigen::Vector3f h = (light_vec + v_vec).normalized();
-        Eigen::Vector3f ls = ks.cwiseProduct(light_power) * std::pow(std::max(0.0f, h.dot(normal)), p);
+        float spec = h.dot(normal);
+        Eigen::Vector3f ls = Eigen::Vector3f::Zero();
+        if (spec > 0.0f)
+            ls = ks.cwiseProduct(light_power) * std::pow(spec, p);
 
         result_color += (la + ld + ls);
     }
@@ -310,10 +321,6 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
     Eigen::Vector3f kd = payload.color;
     Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
 
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
     Eigen::Vector3f amb_light_intensity{10, 10, 10};
     Eigen::Vector3f eye_pos{0, 0, 10};
 
@@ -336,11 +343,8 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
     // Vector ln = (-dU, -dV, 1)
     // Normal n = normalize(TBN * ln)
     Eigen::Vector3f n = normal;
-    float x = normal.x(), y = normal.y(), z = normal.z();
-    // sqrt(x*x+z*z)
-    float s = sqrt(x * x + z * z);
-    float tx = x * y / s, ty = s, tz = z * y / s;
-    Eigen::Vector3f t{tx, ty, tz};
+    // t 在顶点阶段按上面的公式算好插值过来
+    Eigen::Vector3f t = payload.tangent.normalized();
     Eigen::Vector3f b = normal.cross(t);
     // t b n 分别是竖着从左到右放的
     Eigen::Matrix3f TBN;
@@ -349,13 +353,10 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
             t.z(), b.z(), n.z();
     // payload.texture->getColor(payload.tex_coords[0], payload.tex_coords[1])
     // bump mapping 部分的 h(u,v)=texture_color(u,v).norm, 其中 u,v 是 tex_coords, w,h 是 texture 的宽度与高度
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float w = payload.texture->width;
-    float h = payload.texture->height;
-
-    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+    // 两个差分在纹理加载时就算好了，取一次
+    Eigen::Vector3f height = payload.texture->getHeightGradient(payload.tex_coords.x(), payload.tex_coords.y());
+    float dU = kh * kn * height.y();
+    float dV = kh * kn * height.z();
 
     Eigen::Vector3f ln = Eigen::Vector3f(-dU, -dV, 1.0f);
     normal = (TBN * ln).normalized();
@@ -365,6 +366,136 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
     return result_color * 255.f;
 }
 
+// 按名字选着色器，包一层 lambda 交给 f（一般是调用 draw 模板的 lambda）；
+// 每个着色器各自实例化一份 draw，着色器直接内联进光栅化循环。不认识的名字用 phong
+template <typename F>
+void with_shader(const std::string& name, F&& f)
+{
+    if (name == "texture")
+        f([](const fragment_shader_payload& payload) { return texture_fragment_shader(payload); });
+    else if (name == "normal")
+        f([](const fragment_shader_payload& payload) { return normal_fragment_shader(payload); });
+    else if (name == "bump")
+        f([](const fragment_shader_payload& payload) { return bump_fragment_shader(payload); });
+    else if (name == "displacement")
+        f([](const fragment_shader_payload& payload) { return displacement_fragment_shader(payload); });
+    else
+        f([](const fragment_shader_payload& payload) { return phong_fragment_shader(payload); });
+}
+
+// 基准测试用的一个网格，顶点属性按下标对应
+struct bench_scene
+{
+    std::string name;
+    std::vector<Eigen::Vector3f> positions, normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+    std::vector<Eigen::Vector3i> indices;
+};
+
+// 合成场景：半径 radius 的 UV 球，rings x segments 个四边形各拆成两个三角形（正面逆时针朝外），
+// 三角形又多又小，大部分只盖住一两个像素，测的是每个三角形的固定开销
+void make_sphere(float radius, int rings, int segments, bench_scene& scene)
+{
+    for (int i = 0; i <= rings; ++i)
+    {
+        float theta = MY_PI * i / rings;
+        for (int j = 0; j <= segments; ++j)
+        {
+            float phi = 2 * MY_PI * j / segments;
+            Eigen::Vector3f n(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+            scene.positions.push_back(n * radius);
+            scene.normals.push_back(n);
+            scene.tex_coords.emplace_back((float)j / segments, 1 - (float)i / rings);
+        }
+    }
+    for (int i = 0; i < rings; ++i)
+    {
+        for (int j = 0; j < segments; ++j)
+        {
+            int a = i * (segments + 1) + j, b = a + segments + 1;
+            scene.indices.emplace_back(a, b, a + 1);
+            scene.indices.emplace_back(a + 1, b, b + 1);
+        }
+    }
+}
+
+/**
+ * @brief 无窗口的基准测试
+ * 每个场景 x 每个着色器画 frames 帧，模型每帧绕 y 轴多转 360 / frames 度；
+ * 统计每帧的耗时和各阶段（顶点/光栅化/片元/resolve）的耗时、每秒三角形数和每秒着色的片元数。
+ * 每组一行摘要打印出来，完整结果写成 JSON
+ */
+int run_benchmark(rst::rasterizer& r, const std::vector<bench_scene>& scenes, int frames, float start_angle,
+                  bool use_function, const std::string& obj_path, const std::string& json_path)
+{
+    const char* shaders[] = {"normal", "phong", "texture", "bump", "displacement"};
+    // 纹理着色器用 spot 的贴图，凹凸和位移用高度图，和单张渲染时一样；加载不算进耗时
+    Texture color_texture(obj_path + "spot_texture.png");
+    Texture height_texture(obj_path + "hmap.jpg");
+
+    std::ofstream json(json_path);
+    if (!json)
+    {
+        std::cerr << "Cannot write " << json_path << "\n";
+        return 1;
+    }
+    json << "{\n  \"frames\": " << frames << ",\n  \"runs\": [";
+    bool first = true;
+    for (auto& scene : scenes)
+    {
+        // 法线和纹理坐标用的是最后一次加载的，换场景时重新加载；都是 buffer_view，不拷贝
+        auto pos_id = r.load_positions(rst::buffer_view(scene.positions));
+        auto ind_id = r.load_indices(rst::buffer_view(scene.indices));
+        r.load_normals(rst::buffer_view(scene.normals));
+        r.load_tex_coords(rst::buffer_view(scene.tex_coords));
+        rst::col_buf_id col_id{-1};
+
+        for (const char* shader : shaders)
+        {
+            r.set_texture(std::string(shader) == "texture" ? color_texture : height_texture);
+            r.set_fragment_shader(std::string(shader) == "texture" ? texture_fragment_shader
+                                  : std::string(shader) == "normal" ? normal_fragment_shader
+                                  : std::string(shader) == "bump" ? bump_fragment_shader
+                                  : std::string(shader) == "displacement" ? displacement_fragment_shader
+                                                                           : phong_fragment_shader);
+            rst::draw_stats total;
+            double total_ms = 0;
+            for (int f = 0; f < frames; ++f)
+            {
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                r.set_model(get_model_matrix(start_angle + 360.0f * f / frames));
+                auto start = std::chrono::steady_clock::now();
+                if (use_function)
+                    r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+                else
+                    with_shader(shader, [&](auto fs) { r.draw(pos_id, ind_id, col_id, fs); });
+                total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                total += r.last_stats();
+            }
+
+            double seconds = total_ms / 1000;
+            std::cout << scene.name << " / " << shader << ": " << total_ms / frames << " ms/frame (vertex "
+                      << total.vertex_ms / frames << ", raster " << total.raster_ms / frames << ", fragment "
+                      << total.fragment_ms / frames << ", resolve " << total.resolve_ms / frames << "), "
+                      << total.submitted / seconds << " tris/s, " << total.shaded / seconds << " frags/s\n";
+
+            json << (first ? "" : ",") << "\n    {\"scene\": \"" << scene.name << "\", \"shader\": \"" << shader
+                 << "\", \"triangles\": " << scene.indices.size() << ", \"ms_per_frame\": " << total_ms / frames
+                 << ", \"stage_ms\": {\"vertex\": " << total.vertex_ms / frames << ", \"raster\": "
+                 << total.raster_ms / frames << ", \"fragment\": " << total.fragment_ms / frames
+                 << ", \"resolve\": " << total.resolve_ms / frames << "}, \"triangles_per_s\": "
+                 << total.submitted / seconds << ", \"fragments_per_s\": " << total.shaded / seconds
+                 << ", \"culled\": " << total.culled / frames << ", \"occluded\": " << total.occluded / frames
+                 << ", \"shaded_per_frame\": " << total.shaded / frames
+                 << "}";
+            first = false;
+        }
+    }
+    json << "\n  ]\n}\n";
+    std::cout << "Wrote " << json_path << "\n";
+    return 0;
+}
+
 int main(int argc, const char** argv)
 {
     std::vector<Triangle*> TriangleList;
@@ -396,49 +527,176 @@ int main(int argc, const char** argv)
         }
     }
 
+    // 同一个位置/法线/纹理坐标的顶点合并成一个，三角形用下标引用，共享的顶点只变换一次
+    std::vector<Eigen::Vector3f> positions, normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+    std::vector<Eigen::Vector3i> indices;
+    std::map<std::array<float, 8>, int> vertex_ids;
+    for (auto t : TriangleList)
+    {
+        Eigen::Vector3i tri;
+        for (int j = 0; j < 3; ++j)
+        {
+            std::array<float, 8> key = {t->v[j].x(), t->v[j].y(), t->v[j].z(), t->normal[j].x(), t->normal[j].y(),
+                                        t->normal[j].z(), t->tex_coords[j].x(), t->tex_coords[j].y()};
+            auto [it, inserted] = vertex_ids.emplace(key, (int)positions.size());
+            if (inserted)
+            {
+                positions.push_back(t->v[j].head<3>());
+                normals.push_back(t->normal[j]);
+                tex_coords.push_back(t->tex_coords[j]);
+            }
+            tri[j] = it->second;
+        }
+        indices.push_back(tri);
+    }
+    std::cout << TriangleList.size() << " triangles, " << positions.size() << " unique vertices\n";
+
     rst::rasterizer r(700, 700);
 
+    // 网格数据一直活到程序结束，用 buffer_view 直接引用，不拷贝
+    auto pos_id = r.load_positions(rst::buffer_view(positions));
+    auto ind_id = r.load_indices(rst::buffer_view(indices));
+    auto col_id = r.load_colors(std::vector<Eigen::Vector3f>(positions.size(), Eigen::Vector3f(148 / 255.0, 121 / 255.0, 92 / 255.0)));
+    r.load_normals(rst::buffer_view(normals));
+    r.load_tex_coords(rst::buffer_view(tex_coords));
+
     auto texture_path = "hmap.jpg";
     r.set_texture(Texture(obj_path + texture_path));
 
     std::function<Eigen::Vector3f(fragment_shader_payload)> active_shader = phong_fragment_shader;
+    std::string shader_name = "phong";
+    bool use_function = false;
+    bool use_list = false;
+    int num_instances = 0;
+    int num_frames = 1;
+    Eigen::Vector3f eye_pos = {0,0,10};
+
+    // 开关参数：
+    // deferred 先画可见性缓冲，最后每个像素只着色一次
+    // function 走 std::function 版本的 draw（默认用编译期特化的模板版本）
+    auto parse_flag = [&](const std::string& flag) {
+        if (flag == "deferred")
+        {
+            std::cout << "Deferred shading\n";
+            r.set_deferred_shading(true);
+        }
+        else if (flag == "function")
+        {
+            std::cout << "Using std::function shaders\n";
+            use_function = true;
+        }
+        // list 走原来的 TriangleList 接口（每个三角形三个独立顶点）
+        else if (flag == "list")
+        {
+            std::cout << "Drawing the triangle list\n";
+            use_list = true;
+        }
+        // instances=<n> 用实例化绘制把模型画 n 份，排成方阵
+        else if (flag.rfind("instances=", 0) == 0)
+        {
+            num_instances = std::stoi(flag.substr(10));
+            std::cout << "Drawing " << num_instances << " instances\n";
+        }
+        // cull 打开背面剔除
+        else if (flag == "cull")
+        {
+            std::cout << "Back-face culling\n";
+            r.set_backface_culling(true);
+        }
+        // eye=<z> 把相机放到 (0, 0, z)，放得离模型很近时可以看到近平面裁剪
+        else if (flag.rfind("eye=", 0) == 0)
+        {
+            eye_pos.z() = std::stof(flag.substr(4));
+            std::cout << "Eye at z = " << eye_pos.z() << "\n";
+        }
+        // hiz 打开层次 Z 遮挡剔除，two_phase 再加上两阶段（用上一帧的金字塔，至少要画两帧才有效果）
+        else if (flag == "hiz")
+        {
+            std::cout << "Hierarchical-Z occlusion culling\n";
+            r.set_occlusion_culling(true);
+        }
+        else if (flag == "two_phase")
+        {
+            std::cout << "Two-phase occlusion culling\n";
+            r.set_occlusion_culling(true);
+            r.set_two_phase_occlusion(true);
+        }
+        // frames=<n> 同一帧画 n 次，输出和统计都是最后一次的
+        else if (flag.rfind("frames=", 0) == 0)
+        {
+            num_frames = std::max(1, std::stoi(flag.substr(7)));
+            std::cout << "Drawing " << num_frames << " frames\n";
+        }
+    };
+
+    // benchmark [帧数] [开关...]：不开窗口，每个场景 x 每个着色器画若干帧，结果写成 JSON（json=<路径>，默认 benchmark.json）
+    if (argc >= 2 && std::string(argv[1]) == "benchmark")
+    {
+        int frames = argc >= 3 ? std::stoi(argv[2]) : 20;
+        std::string json_path = "benchmark.json";
+        for (int i = 3; i < argc; ++i)
+        {
+            if (std::string(argv[i]).rfind("json=", 0) == 0)
+                json_path = std::string(argv[i]).substr(5);
+            else
+                parse_flag(argv[i]);
+        }
+
+        std::vector<bench_scene> scenes(2);
+        scenes[0].name = "spot";
+        scenes[0].positions = positions;
+        scenes[0].normals = normals;
+        scenes[0].tex_coords = tex_coords;
+        scenes[0].indices = indices;
+        scenes[1].name = "sphere";
+        make_sphere(1.5f, 256, 512, scenes[1]);
+        r.set_vertex_shader(vertex_shader);
+        r.set_view(get_view_matrix(eye_pos));
+        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        r.set_near_plane(0.1);
+        return run_benchmark(r, scenes, frames, angle, use_function, obj_path, json_path);
+    }
 
     if (argc >= 2)
     {
         command_line = true;
         filename = std::string(argv[1]);
 
-        if (argc == 3 && std::string(argv[2]) == "texture")
+        if (argc >= 3 && std::string(argv[2]) == "texture")
         {
             std::cout << "Rasterizing using the texture shader\n";
             active_shader = texture_fragment_shader;
             texture_path = "spot_texture.png";
             r.set_texture(Texture(obj_path + texture_path));
         }
-        else if (argc == 3 && std::string(argv[2]) == "normal")
+        else if (argc >= 3 && std::string(argv[2]) == "normal")
         {
             std::cout << "Rasterizing using the normal shader\n";
             active_shader = normal_fragment_shader;
         }
-        else if (argc == 3 && std::string(argv[2]) == "phong")
+        else if (argc >= 3 && std::string(argv[2]) == "phong")
         {
             std::cout << "Rasterizing using the phong shader\n";
             active_shader = phong_fragment_shader;
         }
-        else if (argc == 3 && std::string(argv[2]) == "bump")
+        else if (argc >= 3 && std::string(argv[2]) == "bump")
         {
             std::cout << "Rasterizing using the bump shader\n";
             active_shader = bump_fragment_shader;
         }
-        else if (argc == 3 && std::string(argv[2]) == "displacement")
+        else if (argc >= 3 && std::string(argv[2]) == "displacement")
         {
             std::cout << "Rasterizing using the bump shader\n";
             active_shader = displacement_fragment_shader;
         }
+        if (argc >= 3)
+            shader_name = argv[2];
+        // 后面的参数是开关，见 parse_flag
+        for (int i = 3; i < argc; ++i)
+            parse_flag(argv[i]);
     }
 
-    Eigen::Vector3f eye_pos = {0,0,10};
-
     r.set_vertex_shader(vertex_shader);
     r.set_fragment_shader(active_shader);
 
@@ -447,12 +705,54 @@ int main(int argc, const char** argv)
 
     if (command_line)
     {
-        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        r.set_near_plane(0.1);
 
-        r.draw(TriangleList);
+        // 实例排成 grid x grid 的方阵，每个缩小到 1 / grid，整体和原来一个模型的大小差不多
+        std::vector<Eigen::Matrix4f> instances;
+        int grid = std::ceil(std::sqrt(num_instances));
+        for (int k = 0; k < num_instances; ++k)
+        {
+            Eigen::Matrix4f place = Eigen::Matrix4f::Identity();
+            place.topLeftCorner<3, 3>() /= grid;
+            place(0, 3) = (k % grid - (grid - 1) / 2.0f) * 5.0f / grid;
+            place(1, 3) = (k / grid - (grid - 1) / 2.0f) * 5.0f / grid;
+            instances.push_back(place * get_model_matrix(angle));
+        }
+
+        // 每个着色器包一层 lambda 传给 draw 模板，各自实例化一份，着色器直接内联进光栅化循环
+        auto draw_with = [&](auto shader) {
+            if (num_instances > 0)
+                r.draw_instanced(pos_id, ind_id, instances, shader);
+            else if (use_list)
+                r.draw(TriangleList, shader);
+            else
+                r.draw(pos_id, ind_id, col_id, shader);
+        };
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < num_frames; ++f)
+        {
+            start = std::chrono::steady_clock::now();
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            if (use_function && num_instances > 0)
+                r.draw_instanced(pos_id, ind_id, instances);
+            else if (use_function && use_list)
+                r.draw(TriangleList);
+            else if (use_function)
+                r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+            else
+                with_shader(shader_name, draw_with);
+        }
+        std::cout << "draw: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms\n";
+        auto& stats = r.last_stats();
+        std::cout << "triangles: " << stats.submitted << " submitted, " << stats.culled << " culled, "
+                  << stats.occluded << " occluded, " << stats.clipped << " clipped\n";
+        std::cout << "fragments: " << stats.covered << " covered, " << stats.depth_passed << " passed depth, "
+                  << stats.shaded << " shaded, " << stats.visible << " visible (overdraw "
+                  << (double)stats.depth_passed / std::max(1LL, stats.visible) << ")\n";
         cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
         image.convertTo(image, CV_8UC3, 1.0f);
         cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
@@ -470,8 +770,7 @@ int main(int argc, const char** argv)
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
 
-        //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        r.draw(TriangleList);
+        r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
         cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
         image.convertTo(image, CV_8UC3, 1.0f);
         cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
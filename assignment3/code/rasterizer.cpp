@@ -6,40 +6,77 @@
 #include "rasterizer.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
+#include <cmath>
+#include <atomic>
+#include <thread>
 
 
 rst::pos_buf_id rst::rasterizer::load_positions(const std::vector<Eigen::Vector3f> &positions)
 {
-    auto id = get_next_id();
-    pos_buf.emplace(id, positions);
+    auto id = store_buffer(pos_buf, positions);
+    pos_bounds[id] = Eigen::AlignedBox3f();
+    for (auto& p : positions)
+        pos_bounds[id].extend(p);
 
     return {id};
 }
 
-rst::ind_buf_id rst::rasterizer::load_indices(const std::vector<Eigen::Vector3i> &indices)
+rst::pos_buf_id rst::rasterizer::load_positions(buffer_view<Eigen::Vector3f> positions)
 {
-    auto id = get_next_id();
-    ind_buf.emplace(id, indices);
+    auto id = store_buffer(pos_buf, positions);
+    pos_bounds[id] = Eigen::AlignedBox3f();
+    for (int i = 0; i < positions.size; ++i)
+        pos_bounds[id].extend(positions.data[i]);
 
     return {id};
 }
 
+rst::ind_buf_id rst::rasterizer::load_indices(const std::vector<Eigen::Vector3i> &indices)
+{
+    return {store_buffer(ind_buf, indices)};
+}
+
+rst::ind_buf_id rst::rasterizer::load_indices(buffer_view<Eigen::Vector3i> indices)
+{
+    return {store_buffer(ind_buf, indices)};
+}
+
 rst::col_buf_id rst::rasterizer::load_colors(const std::vector<Eigen::Vector3f> &cols)
 {
-    auto id = get_next_id();
-    col_buf.emplace(id, cols);
+    return {store_buffer(col_buf, cols)};
+}
 
-    return {id};
+rst::col_buf_id rst::rasterizer::load_colors(buffer_view<Eigen::Vector3f> cols)
+{
+    return {store_buffer(col_buf, cols)};
 }
 
 rst::col_buf_id rst::rasterizer::load_normals(const std::vector<Eigen::Vector3f>& normals)
 {
-    auto id = get_next_id();
-    nor_buf.emplace(id, normals);
+    normal_id = store_buffer(nor_buf, normals);
 
-    normal_id = id;
+    return {normal_id};
+}
 
-    return {id};
+rst::col_buf_id rst::rasterizer::load_normals(buffer_view<Eigen::Vector3f> normals)
+{
+    normal_id = store_buffer(nor_buf, normals);
+
+    return {normal_id};
+}
+
+rst::tex_buf_id rst::rasterizer::load_tex_coords(const std::vector<Eigen::Vector2f>& tex_coords)
+{
+    tex_coord_id = store_buffer(tex_buf, tex_coords);
+
+    return {tex_coord_id};
+}
+
+rst::tex_buf_id rst::rasterizer::load_tex_coords(buffer_view<Eigen::Vector2f> tex_coords)
+{
+    tex_coord_id = store_buffer(tex_buf, tex_coords);
+
+    return {tex_coord_id};
 }
 
 
@@ -144,240 +181,699 @@ void rst::rasterizer::draw_line(Eigen::Vector3f begin, Eigen::Vector3f end)
     }
 }
 
-auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
+namespace
+{
+// 原来 draw 里给每个三角形设的颜色，和 Triangle::setColor(148, 121, 92) 的结果逐位相同
+const Eigen::Vector3f default_color(148 / 255.0, 121 / 255.0, 92 / 255.0);
+
+// 作业里凹凸/位移贴图的切线公式：n = (x, y, z)，t = (x*y/sqrt(x*x+z*z), sqrt(x*x+z*z), z*y/sqrt(x*x+z*z))。
+// 法线正好竖直时公式没有定义，随便取一个和它垂直的方向
+Eigen::Vector3f tangent_of(const Eigen::Vector3f& normal)
 {
-    return Vector4f(v3.x(), v3.y(), v3.z(), w);
+    Eigen::Vector3f n = normal.normalized();
+    float s = std::sqrt(n.x() * n.x() + n.z() * n.z());
+    if (!(s > 0))
+        return Eigen::Vector3f::UnitX();
+    return Eigen::Vector3f(n.x() * n.y() / s, s, n.z() * n.y() / s);
 }
 
-static bool insideTriangle(float x, float y, const Vector3f* _v){
-    Vector3f v[3];
-    for(int i=0;i<3;i++)
-        v[i] = {_v[i].x(),_v[i].y(), 1.0};
-    Vector3f f0,f1,f2;
-    f0 = v[1].cross(v[0]);
-    f1 = v[2].cross(v[1]);
-    f2 = v[0].cross(v[2]);
-    Vector3f p(x,y,1.);
-    if((p.dot(f0)*f0.dot(v[2])>0) && (p.dot(f1)*f1.dot(v[0])>0) && (p.dot(f2)*f2.dot(v[1])>0))
-        return true;
-    return false;
+// 索引缓冲里每 detail::cluster_triangles 个连续的三角形一簇，算每簇顶点的包围盒
+void compute_cluster_bounds(const Eigen::Vector3f* positions, const Eigen::Vector3i* indices, int num_triangles,
+                            std::vector<Eigen::AlignedBox3f>& clusters)
+{
+    clusters.assign((num_triangles + rst::detail::cluster_triangles - 1) / rst::detail::cluster_triangles,
+                    Eigen::AlignedBox3f());
+    for (int i = 0; i < num_triangles; ++i)
+        for (int k = 0; k < 3; ++k)
+            clusters[i / rst::detail::cluster_triangles].extend(positions[indices[i][k]]);
+}
+}
+
+// 把 TriangleList 摊平成索引绘制的输入：每个三角形三个独立的顶点，不共享。
+// TriangleList里面的坐标的w都是1.0；颜色和原来一样统一换成 default_color
+rst::rasterizer::vertex_input rst::rasterizer::triangle_list_input(std::vector<Triangle *> &TriangleList)
+{
+    int num_tris = TriangleList.size();
+    list_positions.resize(3 * num_tris);
+    list_normals.resize(3 * num_tris);
+    list_tex_coords.resize(3 * num_tris);
+    list_colors.assign(3 * num_tris, default_color);
+    list_indices.resize(num_tris);
+    vertex_input input;
+    for (int i = 0; i < num_tris; ++i)
+    {
+        const Triangle* t = TriangleList[i];
+        for (int k = 0; k < 3; ++k)
+        {
+            list_positions[3 * i + k] = t->v[k].head<3>();
+            input.bounds.extend(list_positions[3 * i + k]);
+            list_normals[3 * i + k] = t->normal[k];
+            list_tex_coords[3 * i + k] = t->tex_coords[k];
+        }
+        list_indices[i] = Eigen::Vector3i(3 * i, 3 * i + 1, 3 * i + 2);
+    }
+
+    input.positions = list_positions.data();
+    input.normals = list_normals.data();
+    input.tex_coords = list_tex_coords.data();
+    input.colors = list_colors.data();
+    input.num_vertices = list_positions.size();
+    input.indices = list_indices.data();
+    input.num_triangles = num_tris;
+    if (occlusion_culling)
+    {
+        compute_cluster_bounds(input.positions, input.indices, num_tris, list_clusters);
+        input.clusters = list_clusters.data();
+    }
+    return input;
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f* v){
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+rst::rasterizer::vertex_input rst::rasterizer::buffer_input(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer)
+{
+    auto& buf = pos_buf[pos_buffer.pos_id].view;
+    auto& ind = ind_buf[ind_buffer.ind_id].view;
+
+    vertex_input input;
+    input.positions = buf.data;
+    input.num_vertices = buf.size;
+    input.indices = ind.data;
+    input.num_triangles = ind.size;
+    input.bounds = pos_bounds[pos_buffer.pos_id];
+    // 缓冲的长度和顶点数对不上的属性就当作没有
+    auto attribute = [&](auto& buffers, int id) -> decltype(buffers.begin()->second.view.data) {
+        auto it = buffers.find(id);
+        if (it == buffers.end() || it->second.view.size != input.num_vertices)
+            return nullptr;
+        return it->second.view.data;
+    };
+    input.colors = attribute(col_buf, col_buffer.col_id);
+    input.normals = attribute(nor_buf, normal_id);
+    input.tex_coords = attribute(tex_buf, tex_coord_id);
+    if (occlusion_culling)
+        input.clusters = cluster_bounds_for(pos_buffer, ind_buffer, input);
+    return input;
 }
 
-/**
- * @brief Get the z interpolated object
- * x，y和t都是屏幕坐标
- * Zt = 1 / ( alpha/Za + beta/Zb + gamma/Zc )
- * 这里的Za，Zb和Zc都是相机坐标下的数值，所以v[i].w()需要保留相机坐标下的z的信息
- * 但是这次的作业里面w里面没有保留z的信息...
- * @param x 
- * @param y 
- * @param t 
- * @return float 
- */
-static float get_z_interpolated(float x, float y, const Triangle& t)
+// 簇包围盒按缓冲编号缓存：缓冲加载以后内容不再变（buffer_view 的数组也不能改），只在第一次用的时候算
+const Eigen::AlignedBox3f* rst::rasterizer::cluster_bounds_for(pos_buf_id pos_buffer, ind_buf_id ind_buffer,
+                                                               const vertex_input& input)
 {
-    auto v = t.toVector4();
-    // 计算对应的z，这里要做深度缓存判断                
-    // depth_buf初始化的是设定了全部是infinity
-    auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-    float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-    float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-    // 这里z_interpolated计算出来对应的是真实的z
-    z_interpolated *= w_reciprocal;
-    // 这里为了方便判断depth_buf，直接用负数处理
-    z_interpolated = -z_interpolated;
-    return z_interpolated;
+    auto [it, inserted] = cluster_bounds.try_emplace({pos_buffer.pos_id, ind_buffer.ind_id});
+    if (inserted)
+        compute_cluster_bounds(input.positions, input.indices, input.num_triangles, it->second);
+    return it->second.data();
 }
 
 /**
  * @brief 
- * TriangleList里面的坐标的w都是1.0
- * @param TriangleList 
+ * draw 是 sort-middle 的三段流水线，每段都是多线程的，这里是和着色器无关的前两段：
+ * 0. 整体剔除：物体（实例化时是每个实例）的包围盒完全在视锥外面，或者打开遮挡剔除时被层次 Z 判断挡住，就跳过
+ * 1. 顶点阶段：矩阵每个实例只算一次；每个顶点只变换一次，结果存进 vertices，
+ *    三角形之后按下标引用，共享顶点不再重复变换
+ * 2. 剔除 + 分箱：每个线程先处理自己那一段三角形——完全在某个裁剪面外的丢掉，可选的背面剔除，
+ *    跨近平面的在齐次空间裁剪成几个新三角形——再按包围盒登记到覆盖的屏幕块里，
+ *    再按线程顺序把各线程的列表拼起来，所以每个块里的三角形仍然是提交顺序。
+ *    打开遮挡剔除时每簇三角形先用包围盒做视锥和层次 Z 的判断，整簇跳过
+ * 第 3 段光栅化 + 着色在 rasterizer.hpp 的 draw 模板里
+ * @param input 
+ * @param phase 0 是只有一遍；两阶段剔除时 1 是第一遍，被上一帧的金字塔挡住的推迟到第二遍，
+ *        2 是第二遍，只处理推迟的实例和簇
+ * @return 三角形这一级的统计
  */
-void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+rst::draw_stats rst::rasterizer::setup_triangles(const vertex_input& input, int phase) {
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+    // 相机空间里 (0, 0, -1) 这个点投影之后的 w
+    w_sign = projection(3, 3) - projection(3, 2) >= 0 ? 1 : -1;
+    float guard_x = detail::guard_band / width, guard_y = detail::guard_band / height;
 
-    Eigen::Matrix4f mvp = projection * view * model;
-    for (const auto& t:TriangleList)
+    // 矩阵每个实例只算一次；不是实例化绘制时只有一个实例，用 set_model 的矩阵
+    struct instance_transform
     {
-        Triangle newtri = *t;
-
-        std::array<Eigen::Vector4f, 3> mm {
-                (view * model * t->v[0]),
-                (view * model * t->v[1]),
-                (view * model * t->v[2])
-        };
-        // viewspace_pos只是做了view * model变换之后的位置，不知道有何用？
-        std::array<Eigen::Vector3f, 3> viewspace_pos;
-
-        std::transform(mm.begin(), mm.end(), viewspace_pos.begin(), [](auto& v) {
-            return v.template head<3>();
-        });
-        // std:: cout << "before before:" << t->v[0] << std::endl;
-        // v[]是做了完整的mvp变换的
-        Eigen::Vector4f v[] = {
-                mvp * t->v[0],
-                mvp * t->v[1],
-                mvp * t->v[2]
-        };
-        // std::cout << "z: " << v[0].z() << std::endl;
-        // std::cout << "w: " << v[0].w() << std::endl;
-        // std::cout << "before:" << v[0] << std::endl;
-        // 这里vec.w()没有进行处理，保留了原始的值下来，这个值是mvp变换之后的结果
-        // 前两次作业都是直接vec /= vec.w()的，这次这么做的意图不理解，我觉得是这次作业框架写错了
-        // 这里不是写错了，而是本来想借用w里面的z的信息来做插值矫正的，但是事实上，因为w一开始设定为1.0了，所以其实是没有意义的
-        //Homogeneous division
-        for (auto& vec : v) {
-            vec /= vec.w();
-        }
-        // std::cout << "after:" << v[0] << std::endl;
+        Eigen::Matrix4f mv, mvp;
+        Eigen::Matrix3f inv_trans;
+        bool visible, need_clip;
+    };
+    int num_instances = input.instances ? input.num_instances : 1;
+    std::vector<instance_transform> instance(num_instances);
+    draw_stats totals;
+    int num_clusters = input.clusters ? (input.num_triangles + detail::cluster_triangles - 1) / detail::cluster_triangles : 0;
+    if (phase == 1)
+    {
+        deferred_instances.assign(num_instances, 0);
+        deferred_clusters.assign(num_instances * num_clusters, 0);
+    }
+    for (int k = 0; k < num_instances; ++k)
+    {
+        instance_transform& t = instance[k];
+        t.mv = view * (input.instances ? input.instances[k] : model);
+        t.mvp = projection * t.mv;
         // 不太懂inv_trans的意义，为什么做了求逆还要转置
         // http://games-cn.org/forums/topic/guanyuzuoye3-displacement-mappingdengdewenti/
         // 虎书 6.2.2 Transforming Normal Vectors 有答案
         // 法线的定义是和切线的点乘结果为0，但是通过变换之后的法线变量不一定还是和变换之后的切线垂直，所以会有问题。
         // 这时候需要利用n^T*t = 0 的特性来反过来求出变更之后的法线，答案就是inv_trans了。
-        Eigen::Matrix4f inv_trans = (view * model).inverse().transpose();
-        // std::cout << "inv_trans = " << inv_trans << std::endl;
-        // std::cout << "xx:" << to_vec4(t->normal[0], 0.0f) << std::endl;
-        Eigen::Vector4f n[] = {
-                inv_trans * to_vec4(t->normal[0], 0.0f),
-                inv_trans * to_vec4(t->normal[1], 0.0f),
-                inv_trans * to_vec4(t->normal[2], 0.0f)
-        };
+        // 法线的 w 是 0，只用得到左上角的 3x3
+        t.inv_trans = t.mv.inverse().transpose().topLeftCorner<3, 3>();
+        t.visible = object_visible(t.mvp, input.bounds, t.need_clip);
+        if (phase == 2)
+        {
+            // 第一遍画过的不再画；只推迟了一部分簇的实例留给下面按簇判断
+            t.visible = deferred_instances[k] != 0;
+            if (deferred_instances[k] == 1 && occluded(t.mvp, input.bounds, hiz))
+            {
+                t.visible = false;
+                totals.occluded += input.num_triangles;
+            }
+        }
+        else if (!t.visible)
+            totals.culled += input.num_triangles;
+        else if (occlusion_culling && occluded(t.mvp, input.bounds, hiz))
+        {
+            t.visible = false;
+            totals.occluded += input.num_triangles;
+        }
+        else if (phase == 1 && occluded(t.mvp, input.bounds, previous_hiz))
+        {
+            t.visible = false;
+            deferred_instances[k] = 1;
+        }
+    }
+
+    threads = num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+    if (phase != 2)
+        totals.submitted = num_instances * input.num_triangles;
+    triangles = input.indices;
+    instance_vertices = input.num_vertices;
+    instance_triangles = input.num_triangles;
+    num_input_triangles = num_instances * input.num_triangles;
+    clipped_triangles.clear();
+
+    tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    num_tiles = tiles_x * tiles_y;
+    bins.assign(threads, std::vector<std::vector<int>>(num_tiles));
+
+    int num_vertices = num_instances * input.num_vertices;
+    vertices.resize(num_vertices);
+
+    // 顶点按 4 个一批拼成矩阵的列，一次 4x4 乘 4x4，Eigen 会用 SIMD 做；
+    // 实例 k 的顶点存在 vertices 的 [k * num_vertices, (k + 1) * num_vertices)，一批不跨实例
+    auto transform = [&](int thread_id) {
+        int begin = (long long)num_vertices * thread_id / threads;
+        int end = (long long)num_vertices * (thread_id + 1) / threads;
+        for (int i = begin; i < end;)
+        {
+            int base = i / input.num_vertices * input.num_vertices;
+            int batch_end = std::min(end, base + input.num_vertices);
+            const instance_transform& t = instance[i / input.num_vertices];
+            if (!t.visible)
+            {
+                i = batch_end;
+                continue;
+            }
+            int n = std::min(4, batch_end - i);
+            Eigen::Matrix4f p;
+            Eigen::Matrix<float, 3, 4> nor = Eigen::Matrix<float, 3, 4>::Zero();
+            for (int k = 0; k < 4; ++k)
+            {
+                // 不满 4 个的最后一批用最后一个顶点补齐
+                int j = i - base + std::min(k, n - 1);
+                p.col(k) << input.positions[j], 1.0f;
+                if (input.normals)
+                    nor.col(k) = input.normals[j];
+            }
+            // viewspace_pos只是做了view * model变换之后的位置，给着色器算光照用
+            Eigen::Matrix4f view_space = t.mv * p;
+            // clip是做了完整的mvp变换的
+            Eigen::Matrix4f clip = t.mvp * p;
+            Eigen::Matrix<float, 3, 4> normals = t.inv_trans * nor;
 
-        //Viewport transformation
-        for (auto & vert : v)
+            for (int k = 0; k < n; ++k)
+            {
+                vertex_output& out = vertices[i + k];
+                int j = i - base + k;
+                out.clip = clip.col(k);
+                //screen space coordinates
+                out.screen = viewport(out.clip);
+                // 整个物体都在近平面前面、保护带里面时不用逐个顶点判断
+                out.clip_code = t.need_clip ? clip_code(out.clip, guard_x, guard_y) : 0;
+                out.view_pos = view_space.col(k).head<3>();
+                //view space normal
+                out.normal = normals.col(k);
+                out.tangent = tangent_of(out.normal);
+                out.tex_coords = input.tex_coords ? input.tex_coords[j] : Eigen::Vector2f::Zero();
+                out.color = input.colors ? input.colors[j] : default_color;
+            }
+            i += n;
+        }
+    };
+
+    // 屏幕上逆时针（面积为正）的是正面；裁剪出来的多边形按整个多边形的面积算
+    auto front_facing = [](const vertex_output* poly, int n) {
+        float area = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            const Eigen::Vector4f& a = poly[k].screen;
+            const Eigen::Vector4f& b = poly[(k + 1) % n].screen;
+            area += a.x() * b.y() - a.y() * b.x();
+        }
+        return area > 0;
+    };
+
+    survivors.resize(threads);
+    thread_clip_vertices.resize(threads);
+    thread_clip_triangles.resize(threads);
+    std::vector<draw_stats> thread_totals(threads);
+    auto cull = [&](int thread_id) {
+        int begin = (long long)num_input_triangles * thread_id / threads;
+        int end = (long long)num_input_triangles * (thread_id + 1) / threads;
+        auto& keep = survivors[thread_id];
+        auto& clip_vertices = thread_clip_vertices[thread_id];
+        auto& clip_triangles = thread_clip_triangles[thread_id];
+        keep.clear();
+        clip_vertices.clear();
+        clip_triangles.clear();
+        for (int i = begin; i < end; ++i)
         {
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
+            // 整个实例都被剔除了，跳到下一个实例
+            if (!instance[i / input.num_triangles].visible)
+            {
+                i = std::min(end, (i / input.num_triangles + 1) * input.num_triangles) - 1;
+                continue;
+            }
+            // 每簇开头（或者这个线程的范围从簇中间开始）整簇判断一次，跳过的话直接跳到簇尾
+            int k = i / input.num_triangles, local = i - k * input.num_triangles;
+            if (input.clusters && (i == begin || local % detail::cluster_triangles == 0))
+            {
+                int c = local / detail::cluster_triangles;
+                int cluster_end = std::min(end, k * input.num_triangles +
+                                                    std::min(input.num_triangles, (c + 1) * detail::cluster_triangles));
+                const Eigen::AlignedBox3f& box = input.clusters[c];
+                const instance_transform& t = instance[k];
+                int cluster_id = k * num_clusters + c;
+                long long* counter = nullptr;
+                bool skip = false, need_clip;
+                if (phase == 2 && deferred_instances[k] == 2 && !deferred_clusters[cluster_id])
+                    skip = true;
+                else if (!object_visible(t.mvp, box, need_clip))
+                    counter = &thread_totals[thread_id].culled;
+                else if (occluded(t.mvp, box, hiz))
+                    counter = &thread_totals[thread_id].occluded;
+                else if (phase == 1 && occluded(t.mvp, box, previous_hiz))
+                {
+                    skip = true;
+                    // 簇被两个线程分开时两边的判断一样，只让从簇开头处理的那个线程写
+                    if (local % detail::cluster_triangles == 0)
+                        deferred_clusters[cluster_id] = 1;
+                }
+                if (counter)
+                    *counter += cluster_end - i;
+                if (counter || skip)
+                {
+                    i = cluster_end - 1;
+                    continue;
+                }
+            }
+            Eigen::Vector3i tri = triangle(i);
+            vertex_output poly[detail::max_clip_vertices] = {vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]};
+            int outside_all = poly[0].clip_code & poly[1].clip_code & poly[2].clip_code;
+            int outside_any = poly[0].clip_code | poly[1].clip_code | poly[2].clip_code;
+            // 三个顶点都在同一个面外面
+            if (outside_all)
+            {
+                ++thread_totals[thread_id].culled;
+                continue;
+            }
+            int n = 3;
+            if (outside_any)
+            {
+                ++thread_totals[thread_id].clipped;
+                n = clip_polygon(poly, 3, outside_any);
+                if (n < 3)
+                    continue;
+            }
+            if (cull_backfaces && !front_facing(poly, n))
+            {
+                ++thread_totals[thread_id].culled;
+                continue;
+            }
+            if (!outside_any)
+            {
+                keep.push_back(i);
+                continue;
+            }
+            // 裁剪后的凸多边形扇形三角化，先用线程内的下标，拼起来以后再加上偏移
+            int base = clip_vertices.size();
+            clip_vertices.insert(clip_vertices.end(), poly, poly + n);
+            for (int k = 1; k + 1 < n; ++k)
+            {
+                clip_triangles.emplace_back(base, base + k, base + k + 1);
+                keep.push_back(-(int)clip_triangles.size());
+            }
         }
+    };
 
-        for (int i = 0; i < 3; ++i)
+    std::vector<int> clip_base(threads);
+    auto bin = [&](int thread_id) {
+        for (int s : survivors[thread_id])
         {
-            //screen space coordinates
-            newtri.setVertex(i, v[i]);
+            int i = s >= 0 ? s : clip_base[thread_id] - s - 1;
+            // 分箱：包围盒先裁剪到屏幕内，完全在屏幕外的三角形不进任何块
+            int min_x, min_y, max_x, max_y;
+            if (!screen_bounds(triangle(i), min_x, min_y, max_x, max_y))
+                continue;
+            for (int ty = min_y / tile_size; ty <= max_y / tile_size; ++ty)
+                for (int tx = min_x / tile_size; tx <= max_x / tile_size; ++tx)
+                    bins[thread_id][ty * tiles_x + tx].push_back(i);
         }
+    };
+
+    run_workers(transform);
+    run_workers(cull);
+    // 各线程裁剪出来的顶点和三角形按线程顺序接到后面
+    for (int t = 0; t < threads; ++t)
+    {
+        int vertex_base = vertices.size();
+        clip_base[t] = num_input_triangles + clipped_triangles.size();
+        vertices.insert(vertices.end(), thread_clip_vertices[t].begin(), thread_clip_vertices[t].end());
+        for (auto& tri : thread_clip_triangles[t])
+            clipped_triangles.push_back(tri + Eigen::Vector3i::Constant(vertex_base));
+        totals += thread_totals[t];
+    }
+    run_workers(bin);
 
-        for (int i = 0; i < 3; ++i)
+    if (phase == 1)
+    {
+        // 整个实例没推迟、但有簇推迟了的，第二遍也要处理
+        second_phase_pending = false;
+        for (int k = 0; k < num_instances; ++k)
         {
-            //view space normal
-            newtri.setNormal(i, n[i].head<3>());
+            if (!deferred_instances[k] &&
+                std::any_of(deferred_clusters.begin() + k * num_clusters,
+                            deferred_clusters.begin() + (k + 1) * num_clusters, [](char d) { return d != 0; }))
+                deferred_instances[k] = 2;
+            second_phase_pending |= deferred_instances[k] != 0;
         }
+    }
+    return totals;
+}
+
+// 深度缓冲画过以后重建金字塔：第 0 层是 2x2 像素取最大，往上每层再 2x2 取最大，奇数边长时边上的格子只覆盖一半
+void rst::rasterizer::update_depth_pyramid()
+{
+    if (!hiz_dirty)
+        return;
+    hiz_dirty = false;
+    hiz.empty = false;
+    int w = width, h = height, k = 0;
+    while (w > 1 || h > 1)
+    {
+        int nw = (w + 1) / 2, nh = (h + 1) / 2;
+        if ((int)hiz.levels.size() <= k)
+            hiz.levels.emplace_back();
+        depth_pyramid::level& level = hiz.levels[k];
+        level.width = nw;
+        level.height = nh;
+        level.depth.resize(nw * nh);
+        // 上一层（第 0 层的上一层就是深度缓冲本身）在 (x, y) 的深度
+        auto fine = [&](int x, int y) {
+            return k == 0 ? depth_buf[get_index(x, y)] : hiz.levels[k - 1].depth[y * w + x];
+        };
+        for (int y = 0; y < nh; ++y)
+            for (int x = 0; x < nw; ++x)
+            {
+                int x1 = std::min(2 * x + 1, w - 1), y1 = std::min(2 * y + 1, h - 1);
+                level.depth[y * nw + x] = std::max(std::max(fine(2 * x, 2 * y), fine(x1, 2 * y)),
+                                                   std::max(fine(2 * x, y1), fine(x1, y1)));
+            }
+        w = nw;
+        h = nh;
+        ++k;
+    }
+    hiz.levels.resize(k);
+}
+
+/**
+ * @brief 包围盒是不是整个被挡住了
+ * 8 个角投影到屏幕上，取屏幕上的外接矩形和最近的深度（包围盒在近平面前面时，变换后的凸包包住了盒子里的所有点）；
+ * 在金字塔里找矩形最多跨 4x4 格的那一层（格子越粗越容易混进背景），这几格里最远的深度都比盒子最近的点还近，
+ * 盒子里的东西就全都通不过深度测试。
+ * 有角在近平面后面、矩形和屏幕不相交的不判断，交给视锥剔除和裁剪
+ */
+bool rst::rasterizer::occluded(const Eigen::Matrix4f& mvp, const Eigen::AlignedBox3f& bounds,
+                               const depth_pyramid& pyramid) const
+{
+    if (pyramid.empty || pyramid.levels.empty() || bounds.isEmpty())
+        return false;
+    float min_x = std::numeric_limits<float>::infinity(), max_x = -min_x, min_y = min_x, max_y = -min_x;
+    float nearest = min_x;
+    for (int k = 0; k < 8; ++k)
+    {
+        Eigen::Vector4f corner;
+        corner << bounds.corner((Eigen::AlignedBox3f::CornerType)k), 1.0f;
+        Eigen::Vector4f clip = mvp * corner;
+        if (!(w_sign * clip.w() >= near_plane))
+            return false;
+        Eigen::Vector4f screen = viewport(clip);
+        min_x = std::min(min_x, screen.x());
+        max_x = std::max(max_x, screen.x());
+        min_y = std::min(min_y, screen.y());
+        max_y = std::max(max_y, screen.y());
+        // 深度缓冲里存的是 -z，见 get_z_interpolated
+        nearest = std::min(nearest, -screen.z());
+    }
+    // 和 screen_bounds 一样向外取整
+    int x0 = std::max(0, (int)std::floor(min_x)), x1 = std::min(width - 1, (int)std::ceil(max_x));
+    int y0 = std::max(0, (int)std::floor(min_y)), y1 = std::min(height - 1, (int)std::ceil(max_y));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    int k = 0, last = pyramid.levels.size() - 1;
+    while (k < last && ((x1 >> (k + 1)) - (x0 >> (k + 1)) > 3 || (y1 >> (k + 1)) - (y0 >> (k + 1)) > 3))
+        ++k;
+    const depth_pyramid::level& level = pyramid.levels[k];
+    float farthest = -std::numeric_limits<float>::infinity();
+    for (int y = std::min(y0 >> (k + 1), level.height - 1); y <= std::min(y1 >> (k + 1), level.height - 1); ++y)
+        for (int x = std::min(x0 >> (k + 1), level.width - 1); x <= std::min(x1 >> (k + 1), level.width - 1); ++x)
+            farthest = std::max(farthest, level.depth[y * level.width + x]);
+    return nearest > farthest + detail::hiz_epsilon;
+}
+
+// 透视除法 + 视口变换
+Eigen::Vector4f rst::rasterizer::viewport(Eigen::Vector4f vert) const
+{
+    float f1 = (50 - 0.1) / 2.0;
+    float f2 = (50 + 0.1) / 2.0;
 
-        newtri.setColor(0, 148,121.0,92.0);
-        newtri.setColor(1, 148,121.0,92.0);
-        newtri.setColor(2, 148,121.0,92.0);
+    //Homogeneous division
+    vert /= vert.w();
+    //Viewport transformation
+    vert.x() = 0.5*width*(vert.x()+1.0);
+    vert.y() = 0.5*height*(vert.y()+1.0);
+    vert.z() = vert.z() * f1 + f2;
+    return vert;
+}
 
-        // Also pass view space vertice position
-        rasterize_triangle(newtri, viewspace_pos);
+/**
+ * @brief 裁剪空间的点到某个裁剪面的有向距离，>= 0 是在里面
+ * 近平面是相机空间的深度 w_sign * w >= near_plane；
+ * 左右上下是 |x| <= extent_x * |w|、|y| <= extent_y * |w|，extent 是 1 时就是屏幕的边，取保护带时更宽
+ */
+float rst::rasterizer::clip_distance(const Eigen::Vector4f& clip, int plane, float extent_x, float extent_y) const
+{
+    float w = w_sign * clip.w();
+    switch (plane)
+    {
+    case detail::clip_near:
+        return w - near_plane;
+    case detail::clip_left:
+        return extent_x * w + clip.x();
+    case detail::clip_right:
+        return extent_x * w - clip.x();
+    case detail::clip_bottom:
+        return extent_y * w + clip.y();
+    default:
+        return extent_y * w - clip.y();
     }
 }
 
+int rst::rasterizer::clip_code(const Eigen::Vector4f& clip, float extent_x, float extent_y) const
+{
+    int code = 0;
+    for (int plane = detail::clip_near; plane <= detail::clip_top; plane <<= 1)
+        // 写成 !(... >= 0) 顺便把 NaN 当成在外面
+        if (!(clip_distance(clip, plane, extent_x, extent_y) >= 0))
+            code |= plane;
+    return code;
+}
+
 /**
- * @brief 这里是做了简化版的插值处理，没有考虑到深度矫正的
- * 
- * @param alpha 
- * @param beta 
- * @param gamma 
- * @param vert1 
- * @param vert2 
- * @param vert3 
- * @param weight 
- * @return Eigen::Vector3f 
+ * @brief Sutherland-Hodgman：poly 里的凸多边形依次对 planes 里的每个面裁剪，结果写回 poly
+ * 新顶点的属性在裁剪空间里沿边线性插值，屏幕坐标由插值后的裁剪坐标重新算
+ * @return 裁剪后的顶点数，小于 3 表示整个被裁掉了
  */
-static Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f& vert1, const Eigen::Vector3f& vert2, const Eigen::Vector3f& vert3, float weight)
-{
-    return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
-}
-
-static Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const Eigen::Vector2f& vert1, const Eigen::Vector2f& vert2, const Eigen::Vector2f& vert3, float weight)
-{
-    auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
-    auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
-
-    u /= weight;
-    v /= weight;
-
-    return Eigen::Vector2f(u, v);
-}
-
-//Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos) 
-{
-    auto v = t.toVector4(); 
-    // std::cout << "v0:" << v.at(0).x() << "," << v.at(0).y() << "," << v.at(0).z() << std::endl;
-    // std::cout << "v1:" << v.at(1).x() << "," << v.at(1).y() << "," << v.at(1).z() << std::endl;
-    // std::cout << "v2:" << v.at(2).x() << "," << v.at(2).y() << "," << v.at(2).z() << std::endl;
-
-    // TODO : Find out the bounding box of current triangle.    
-    float x_arr[] = {v.at(0).x(), v.at(1).x(), v.at(2).x()};
-    float y_arr[] = {v.at(0).y(), v.at(1).y(), v.at(2).y()};
-    int min_x = std::floor(static_cast<double>(*std::min_element(std::begin(x_arr), std::end(x_arr))));
-    int max_x = std::ceil(static_cast<double>(*std::max_element(std::begin(x_arr), std::end(x_arr))));
-    int min_y = std::floor(static_cast<double>(*std::min_element(std::begin(y_arr), std::end(y_arr))));
-    int max_y = std::ceil(static_cast<double>(*std::max_element(std::begin(y_arr), std::end(y_arr))));
-
-    std::array<Eigen::Vector3f, 3> res;
-    std::transform(std::begin(v), std::end(v), res.begin(), [](auto& vec) { return Eigen::Vector3f(vec.x(), vec.y(), vec.z()); });
-    for( int x = min_x; x<=max_x; x++ ) {
-        for( int y = min_y; y<=max_y; y++ ) {
-            // 这里修改了一下，中心设定为(x+0.5, y+0.5)
-            bool is_inside = insideTriangle(1.0f * (x + 0.5f), 1.0f * (y + 0.5f), res.data());
-            if( is_inside ){                
-                float z_interpolated = get_z_interpolated(1.0f * x, 1.0f * y, t);
-                int index = get_index(x, y);             
-                float old_z = depth_buf[index];
-                // 当前z的比旧的小，需要进行更新
-                if( z_interpolated < old_z ){
-                    depth_buf[index] = z_interpolated;
-                    auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-                    auto interpolated_color = interpolate(alpha, beta, gamma, t.color[0], t.color[1], t.color[2], 1);
-                    auto interpolated_normal = interpolate(alpha, beta, gamma, t.normal[0], t.normal[1], t.normal[2], 1);
-                    auto interpolated_texcoords = interpolate(alpha, beta, gamma, t.tex_coords[0], t.tex_coords[1], t.tex_coords[2], 1);
-                    auto interpolated_shadingcoords = interpolate(alpha, beta, gamma, view_pos[0], view_pos[1], view_pos[2], 1);
-                    fragment_shader_payload payload = fragment_shader_payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-                    payload.view_pos = interpolated_shadingcoords;
-                    auto pixel_color = fragment_shader(payload);
-                    Eigen::Vector2i point = Eigen::Vector2i(x, y);
-                    set_pixel(point, pixel_color);
-                }
+int rst::rasterizer::clip_polygon(vertex_output* poly, int n, int planes) const
+{
+    float guard_x = detail::guard_band / width, guard_y = detail::guard_band / height;
+    vertex_output out[detail::max_clip_vertices];
+    for (int plane = detail::clip_near; plane <= detail::clip_top; plane <<= 1)
+    {
+        if (!(planes & plane))
+            continue;
+        int m = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            const vertex_output& a = poly[k];
+            const vertex_output& b = poly[(k + 1) % n];
+            float da = clip_distance(a.clip, plane, guard_x, guard_y);
+            float db = clip_distance(b.clip, plane, guard_x, guard_y);
+            if (da >= 0)
+                out[m++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                float t = da / (da - db);
+                vertex_output& v = out[m++];
+                v.clip = a.clip + (b.clip - a.clip) * t;
+                v.screen = viewport(v.clip);
+                v.view_pos = a.view_pos + (b.view_pos - a.view_pos) * t;
+                v.normal = a.normal + (b.normal - a.normal) * t;
+                v.tangent = a.tangent + (b.tangent - a.tangent) * t;
+                v.tex_coords = a.tex_coords + (b.tex_coords - a.tex_coords) * t;
+                v.color = a.color + (b.color - a.color) * t;
+                v.clip_code = 0;
             }
         }
-    }    
-    // TODO: From your HW3, get the triangle rasterization code.
-    // TODO: Inside your rasterization loop:
-    // 这里的注释应该写错了,v[i].z()才是
-    // 没有写错，只是这次在初始化顶点坐标的时候w直接设定为1.0了，待会可以试试把w设定为z试试
-    //    * v[i].w() is the vertex view space depth value z.
-    //    * Z is interpolated view space depth for the current pixel
-    //    * zp is depth between zNear and zFar, used for z-buffer
+        n = m;
+        if (n < 3)
+            return n;
+        std::copy(out, out + n, poly);
+    }
+    return n;
+}
+
+/**
+ * @brief 整体视锥剔除：包围盒的 8 个角变换到裁剪空间，全部在同一个面（近平面或屏幕的某条边）外面，
+ * 物体就整个看不见。包围盒变换后的凸包包住了物体，这个判断只会漏剔，不会错剔
+ * @param need_clip 8 个角都在近平面前面、保护带里面时为 false，里面的三角形都不用裁剪
+ */
+bool rst::rasterizer::object_visible(const Eigen::Matrix4f& mvp, const Eigen::AlignedBox3f& bounds, bool& need_clip) const
+{
+    need_clip = true;
+    if (bounds.isEmpty())
+        return true;
+    float guard_x = detail::guard_band / width, guard_y = detail::guard_band / height;
+    int outside_all = ~0, outside_guard = 0;
+    for (int k = 0; k < 8; ++k)
+    {
+        Eigen::Vector4f corner;
+        corner << bounds.corner((Eigen::AlignedBox3f::CornerType)k), 1.0f;
+        Eigen::Vector4f clip = mvp * corner;
+        outside_all &= clip_code(clip, 1, 1);
+        outside_guard |= clip_code(clip, guard_x, guard_y);
+    }
+    need_clip = outside_guard != 0;
+    return outside_all == 0;
+}
+
+void rst::rasterizer::run_workers(const std::function<void(int)>& job)
+{
+    pool.run(threads, job);
+}
+
+void rst::worker_pool::run(int n, const std::function<void(int)>& f)
+{
+    if (n <= 1)
+    {
+        f(0);
+        return;
+    }
+    if ((int)workers.size() != n - 1)
+    {
+        stop();
+        exiting = false;
+        for (int k = 1; k < n; ++k)
+            workers.emplace_back(&worker_pool::work, this, k, generation);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &f;
+        pending = n - 1;
+        ++generation;
+    }
+    wake.notify_all();
+    f(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+void rst::worker_pool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exiting = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+    workers.clear();
+}
+
+void rst::worker_pool::work(int id, unsigned long long seen)
+{
+    for (;;)
+    {
+        const std::function<void(int)>* f;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return exiting || generation != seen; });
+            if (exiting)
+                return;
+            seen = generation;
+            f = job;
+        }
+        (*f)(id);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
 
-    // float Z = 1.0 / (alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-    // float zp = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-    // zp *= Z;
+// std::function 版本，着色器是运行时设置的，每个片元一次间接调用
+void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList)
+{
+    draw(TriangleList, [this](const fragment_shader_payload& payload) { return fragment_shader(payload); });
+}
 
-    // TODO: Interpolate the attributes:
-    // auto interpolated_color
-    // auto interpolated_normal
-    // auto interpolated_texcoords
-    // auto interpolated_shadingcoords
+void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
+{
+    if (type != rst::Primitive::Triangle)
+    {
+        throw std::runtime_error("Drawing primitives other than triangle is not implemented yet!");
+    }
+    draw(pos_buffer, ind_buffer, col_buffer,
+         [this](const fragment_shader_payload& payload) { return fragment_shader(payload); });
+}
 
-    // Use: fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-    // Use: payload.view_pos = interpolated_shadingcoords;
-    // Use: Instead of passing the triangle's color directly to the frame buffer, pass the color to the shaders first to get the final color;
-    // Use: auto pixel_color = fragment_shader(payload);
+void rst::rasterizer::draw_instanced(pos_buf_id pos_buffer, ind_buf_id ind_buffer, const std::vector<Eigen::Matrix4f>& instances)
+{
+    draw_instanced(pos_buffer, ind_buffer, instances,
+                   [this](const fragment_shader_payload& payload) { return fragment_shader(payload); });
+}
 
- 
+// 三角形在屏幕上的包围盒（像素，闭区间），裁剪到 [0, width) x [0, height)；和屏幕不相交时返回 false
+bool rst::rasterizer::screen_bounds(const Eigen::Vector3i& tri, int& min_x, int& min_y, int& max_x, int& max_y) const
+{
+    const Eigen::Vector4f& a = vertices[tri[0]].screen;
+    const Eigen::Vector4f& b = vertices[tri[1]].screen;
+    const Eigen::Vector4f& c = vertices[tri[2]].screen;
+    float x_arr[] = {a.x(), b.x(), c.x()};
+    float y_arr[] = {a.y(), b.y(), c.y()};
+    min_x = std::max(0, (int)std::floor(*std::min_element(std::begin(x_arr), std::end(x_arr))));
+    max_x = std::min(width - 1, (int)std::ceil(*std::max_element(std::begin(x_arr), std::end(x_arr))));
+    min_y = std::max(0, (int)std::floor(*std::min_element(std::begin(y_arr), std::end(y_arr))));
+    max_y = std::min(height - 1, (int)std::ceil(*std::max_element(std::begin(y_arr), std::end(y_arr))));
+    return min_x <= max_x && min_y <= max_y;
 }
 
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
@@ -403,6 +899,14 @@ void rst::rasterizer::clear(rst::Buffers buff)
     }
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
+        // 两阶段遮挡剔除要用上一帧的金字塔，清空之前先留下来
+        if (occlusion_culling && two_phase_occlusion)
+        {
+            update_depth_pyramid();
+            std::swap(hiz, previous_hiz);
+        }
+        hiz.empty = true;
+        hiz_dirty = false;
         std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
     }
 }
@@ -411,20 +915,18 @@ rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 {
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
+    id_buf.resize(w * h, -1);
+    bary_buf.resize(w * h);
 
     texture = std::nullopt;
 }
 
-int rst::rasterizer::get_index(int x, int y)
-{
-    return (height-y)*width + x;
-}
-
 void rst::rasterizer::set_pixel(const Vector2i &point, const Eigen::Vector3f &color)
 {
     //old index: auto ind = point.y() + point.x() * width;
-    int ind = (height-point.y())*width + point.x();
-    frame_buf[ind] = color;
+    if (point.x() < 0 || point.x() >= width || point.y() < 0 || point.y() >= height)
+        return;
+    frame_buf[get_index(point.x(), point.y())] = color;
 }
 
 void rst::rasterizer::set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader)
@@ -7,6 +7,15 @@
 #include <eigen3/Eigen/Eigen>
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include "global.hpp"
 #include "Shader.hpp"
 #include "Triangle.hpp"
@@ -57,6 +66,91 @@ namespace rst
         int col_id = 0;
     };
 
+    struct tex_buf_id
+    {
+        int tex_id = 0;
+    };
+
+    // 调用者的数组，不拷贝：只记指针和长度，调用者要保证画的时候数组还在、没有重新分配
+    template <typename T>
+    struct buffer_view
+    {
+        const T* data = nullptr;
+        int size = 0;
+
+        buffer_view() = default;
+        buffer_view(const T* data, int size) : data(data), size(size) {}
+        explicit buffer_view(const std::vector<T>& v) : data(v.data()), size(v.size()) {}
+    };
+
+    // 上一次 draw 的统计：covered 是通过覆盖测试的片元数，depth_passed 是通过深度测试的片元数，
+    // shaded 是实际调用 fragment_shader 的次数。overdraw = depth_passed / visible
+    // 三角形这一级：submitted 是提交的个数，culled 是整体视锥剔除、背面剔除、完全在某个裁剪面外面丢掉的，
+    // clipped 是跨过近平面（或者超出保护带）需要裁剪的，occluded 是层次 Z 判断被挡住、整个实例或整簇跳过的
+    // 各阶段耗时（毫秒）：vertex 是顶点变换 + 剔除裁剪 + 分箱，raster 是块的光栅化（前向着色时包括着色），
+    // fragment 是延迟着色那一遍，resolve 这个光栅化器没有（没有多重采样），一直是 0
+    struct draw_stats
+    {
+        long long submitted = 0;
+        long long culled = 0;
+        long long clipped = 0;
+        long long occluded = 0;
+        long long covered = 0;
+        long long depth_passed = 0;
+        long long shaded = 0;
+        long long visible = 0;
+        double vertex_ms = 0;
+        double raster_ms = 0;
+        double fragment_ms = 0;
+        double resolve_ms = 0;
+
+        draw_stats& operator+=(const draw_stats& o)
+        {
+            submitted += o.submitted;
+            culled += o.culled;
+            clipped += o.clipped;
+            occluded += o.occluded;
+            covered += o.covered;
+            depth_passed += o.depth_passed;
+            shaded += o.shaded;
+            visible += o.visible;
+            vertex_ms += o.vertex_ms;
+            raster_ms += o.raster_ms;
+            fragment_ms += o.fragment_ms;
+            resolve_ms += o.resolve_ms;
+            return *this;
+        }
+    };
+
+    /**
+     * @brief 常驻的工作线程：第一次 run 时创建，之后每个阶段只是把任务交给它们、唤醒一次。
+     * run(n, job) 在 n 个线程上各调用一次 job(0..n-1)，job(0) 在调用线程上跑，全部返回后 run 才返回；
+     * n 变了（set_threads）就把原来的线程停掉重建
+     */
+    class worker_pool
+    {
+    public:
+        worker_pool() = default;
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+        ~worker_pool() { stop(); }
+
+        void run(int n, const std::function<void(int)>& job);
+
+    private:
+        void stop();
+        void work(int id, unsigned long long generation);
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake, done;
+        const std::function<void(int)>* job = nullptr;
+        // 每派发一次加一，工作线程靠它分辨是不是新任务
+        unsigned long long generation = 0;
+        int pending = 0;
+        bool exiting = false;
+    };
+
     class rasterizer
     {
     public:
@@ -65,6 +159,14 @@ namespace rst
         ind_buf_id load_indices(const std::vector<Eigen::Vector3i>& indices);
         col_buf_id load_colors(const std::vector<Eigen::Vector3f>& colors);
         col_buf_id load_normals(const std::vector<Eigen::Vector3f>& normals);
+        // 和 load_normals 一样，最后一次加载的纹理坐标会被索引绘制使用
+        tex_buf_id load_tex_coords(const std::vector<Eigen::Vector2f>& tex_coords);
+        // 上面几个会把数据拷贝一份；传 buffer_view 的版本直接引用调用者的数组，同一份顶点数据可以给多个缓冲共用
+        pos_buf_id load_positions(buffer_view<Eigen::Vector3f> positions);
+        ind_buf_id load_indices(buffer_view<Eigen::Vector3i> indices);
+        col_buf_id load_colors(buffer_view<Eigen::Vector3f> colors);
+        col_buf_id load_normals(buffer_view<Eigen::Vector3f> normals);
+        tex_buf_id load_tex_coords(buffer_view<Eigen::Vector2f> tex_coords);
 
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
@@ -79,15 +181,132 @@ namespace rst
 
         void clear(Buffers buff);
 
+        // 索引绘制：顶点属性在 load_* 的缓冲里，法线和纹理坐标用最后一次加载的那份，
+        // 共享的顶点只变换一次
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
         void draw(std::vector<Triangle *> &TriangleList);
+        // 编译期指定着色器的版本：FS 是任何能以 (const fragment_shader_payload&) 调用、返回颜色的类型，
+        // 传 lambda 时着色器会被内联进光栅化循环，没有 std::function 的间接调用和 payload 拷贝
+        template <typename FS>
+        void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, const FS& frag_shader);
+        template <typename FS>
+        void draw(std::vector<Triangle *> &TriangleList, const FS& frag_shader);
+        // 实例化绘制：同一份网格画 instances.size() 次，每个实例用自己的模型矩阵（代替 set_model 的），
+        // 颜色统一用默认色。顶点按实例分批变换，矩阵每个实例算一次，包围盒整个在视锥外的实例直接跳过
+        void draw_instanced(pos_buf_id pos_buffer, ind_buf_id ind_buffer, const std::vector<Eigen::Matrix4f>& instances);
+        template <typename FS>
+        void draw_instanced(pos_buf_id pos_buffer, ind_buf_id ind_buffer, const std::vector<Eigen::Matrix4f>& instances,
+                            const FS& frag_shader);
 
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
 
+        // draw 用的工作线程数（0 表示 hardware_concurrency）和屏幕块的边长（像素）
+        void set_threads(int n) { num_threads = n; }
+        // 着色按 2x2 的 quad 进行，块边长取偶数，quad 不会跨块
+        void set_tile_size(int size) { tile_size = std::max(8, size + (size & 1)); }
+
+        // 延迟着色：光栅化只写深度和可见性缓冲（三角形编号 + 重心坐标），
+        // 画完之后每个像素只着色一次，着色次数和深度复杂度无关
+        void set_deferred_shading(bool on) { deferred = on; }
+        const draw_stats& last_stats() const { return stats; }
+
+        // 近平面到相机的距离，和投影矩阵的 zNear 一致。跨近平面的三角形在齐次空间裁剪，
+        // 屏幕边缘不裁剪，交给保护带和包围盒的裁剪
+        void set_near_plane(float z_near) { near_plane = z_near; }
+        // 背面剔除：模型的正面是逆时针，投影到屏幕上是顺时针的三角形直接丢掉
+        void set_backface_culling(bool on) { cull_backfaces = on; }
+        // 层次 Z 遮挡剔除：深度缓冲建一个取最大深度的金字塔，物体（实例）和每簇三角形的包围盒
+        // 在做任何顶点/三角形处理之前先和它比，比包围盒覆盖的区域里最远的深度还远就整个跳过。
+        // 只用得到这一帧之前的 draw 画下的深度，所以先画近处的大物体效果最好
+        void set_occlusion_culling(bool on) { occlusion_culling = on; }
+        // 两阶段遮挡剔除（要同时打开 set_occlusion_culling）：clear 深度时留下上一帧的金字塔，
+        // 第一遍只画上一帧没被挡住的，用画完的深度重建金字塔，再对第一遍推迟的那些重新判断，没被挡住的补画
+        void set_two_phase_occlusion(bool on) { two_phase_occlusion = on; }
+
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
-        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos);
+        // 顶点阶段的输入：各属性数组按同一个顶点下标对应，没有的属性传 nullptr；三角形是三个顶点下标
+        struct vertex_input
+        {
+            const Eigen::Vector3f* positions = nullptr;
+            const Eigen::Vector3f* normals = nullptr;
+            const Eigen::Vector2f* tex_coords = nullptr;
+            const Eigen::Vector3f* colors = nullptr;
+            int num_vertices = 0;
+            const Eigen::Vector3i* indices = nullptr;
+            int num_triangles = 0;
+            // 模型空间的包围盒，整体视锥剔除用；空的包围盒表示不知道，不做剔除
+            Eigen::AlignedBox3f bounds;
+            // 每个实例的模型矩阵，nullptr 表示只画一次、用 set_model 的矩阵
+            const Eigen::Matrix4f* instances = nullptr;
+            int num_instances = 1;
+            // 每 detail::cluster_triangles 个三角形一簇的模型空间包围盒，遮挡剔除用；nullptr 表示不按簇剔除
+            const Eigen::AlignedBox3f* clusters = nullptr;
+        };
+
+        // 层次 Z：levels[k] 的一格是 2^(k+1) x 2^(k+1) 个像素里最远（最大）的深度，y 向上，最后一层是 1x1。
+        // 没画过东西的像素深度是 infinity，包含它的格子什么都挡不住，所以这个判断只会漏剔，不会错剔
+        struct depth_pyramid
+        {
+            struct level
+            {
+                int width, height;
+                std::vector<float> depth;
+            };
+            std::vector<level> levels;
+            // 深度缓冲清空以后还没画过东西
+            bool empty = true;
+        };
+
+        // 变换之后的顶点（post-transform buffer），光栅化和着色都按下标从这里取
+        struct vertex_output
+        {
+            Eigen::Vector4f clip;
+            Eigen::Vector4f screen;
+            Eigen::Vector3f view_pos;
+            Eigen::Vector3f normal;
+            Eigen::Vector3f tangent;
+            Eigen::Vector2f tex_coords;
+            Eigen::Vector3f color;
+            // 在哪些裁剪面外面，detail::clip_near 等位的组合
+            int clip_code;
+        };
+
+        vertex_input buffer_input(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer);
+        vertex_input triangle_list_input(std::vector<Triangle *> &TriangleList);
+        draw_stats setup_triangles(const vertex_input& input, int phase);
+        const Eigen::AlignedBox3f* cluster_bounds_for(pos_buf_id pos_buffer, ind_buf_id ind_buffer, const vertex_input& input);
+        void update_depth_pyramid();
+        bool occluded(const Eigen::Matrix4f& mvp, const Eigen::AlignedBox3f& bounds, const depth_pyramid& pyramid) const;
+        Eigen::Vector4f viewport(Eigen::Vector4f clip) const;
+        float clip_distance(const Eigen::Vector4f& clip, int plane, float extent_x, float extent_y) const;
+        int clip_code(const Eigen::Vector4f& clip, float extent_x, float extent_y) const;
+        int clip_polygon(vertex_output* poly, int n, int planes) const;
+        bool object_visible(const Eigen::Matrix4f& mvp, const Eigen::AlignedBox3f& bounds, bool& need_clip) const;
+        // 编号小于 num_input_triangles 的是调用者的三角形（实例化时按实例依次排开），后面的是裁剪生成的
+        Eigen::Vector3i triangle(int id) const
+        {
+            if (id < instance_triangles)
+                return triangles[id];
+            if (id >= num_input_triangles)
+                return clipped_triangles[id - num_input_triangles];
+            // 第 k 个实例的三角形编号从 k * instance_triangles 开始，顶点下标整体偏移 k * instance_vertices
+            int k = id / instance_triangles;
+            return triangles[id - k * instance_triangles] + Eigen::Vector3i::Constant(k * instance_vertices);
+        }
+        void run_workers(const std::function<void(int)>& job);
+        template <typename FS>
+        void draw_indexed(const vertex_input& input, const FS& frag_shader);
+        template <typename FS>
+        draw_stats draw_pass(const vertex_input& input, const FS& frag_shader, int phase);
+        template <typename FS>
+        void rasterize_triangle(const FS& frag_shader, const Eigen::Vector3i& tri, int tri_id,
+                                int x0, int y0, int x1, int y1, draw_stats& tile_stats);
+        template <typename FS>
+        Eigen::Vector3f shade_fragment(const FS& frag_shader, const Eigen::Vector3i& tri, float alpha, float beta,
+                                       float gamma, const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy);
+        bool screen_bounds(const Eigen::Vector3i& tri, int& min_x, int& min_y, int& max_x, int& max_y) const;
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -97,11 +316,40 @@ namespace rst
         Eigen::Matrix4f projection;
 
         int normal_id = -1;
+        int tex_coord_id = -1;
 
-        std::map<int, std::vector<Eigen::Vector3f>> pos_buf;
-        std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
-        std::map<int, std::vector<Eigen::Vector3f>> col_buf;
-        std::map<int, std::vector<Eigen::Vector3f>> nor_buf;
+        // 缓冲：拷贝进来的数据存在 storage 里，view 指向它；用 buffer_view 加载的 storage 是空的
+        template <typename T>
+        struct stored_buffer
+        {
+            std::vector<T> storage;
+            buffer_view<T> view;
+        };
+
+        template <typename T>
+        int store_buffer(std::map<int, stored_buffer<T>>& buffers, const std::vector<T>& data)
+        {
+            auto id = get_next_id();
+            auto& buffer = buffers[id];
+            buffer.storage = data;
+            buffer.view = buffer_view<T>(buffer.storage);
+            return id;
+        }
+
+        template <typename T>
+        int store_buffer(std::map<int, stored_buffer<T>>& buffers, buffer_view<T> view)
+        {
+            auto id = get_next_id();
+            buffers[id].view = view;
+            return id;
+        }
+
+        std::map<int, stored_buffer<Eigen::Vector3f>> pos_buf;
+        std::map<int, Eigen::AlignedBox3f> pos_bounds;
+        std::map<int, stored_buffer<Eigen::Vector3i>> ind_buf;
+        std::map<int, stored_buffer<Eigen::Vector3f>> col_buf;
+        std::map<int, stored_buffer<Eigen::Vector3f>> nor_buf;
+        std::map<int, stored_buffer<Eigen::Vector2f>> tex_buf;
 
         std::optional<Texture> texture;
 
@@ -110,11 +358,464 @@ namespace rst
 
         std::vector<Eigen::Vector3f> frame_buf;
         std::vector<float> depth_buf;
-        int get_index(int x, int y);
+        // 可见性缓冲：本次 draw 里每个像素最近的三角形编号（-1 表示没有）和它的 beta、gamma
+        std::vector<int> id_buf;
+        std::vector<Eigen::Vector2f> bary_buf;
+        // 屏幕坐标的 y 向上，帧缓冲的行从上往下存；原来的 (height-y) 在 y = 0 时会越界
+        int get_index(int x, int y) const { return (height-1-y)*width + x; }
 
         int width, height;
 
+        int num_threads = 0;
+        int tile_size = 32;
+        bool deferred = false;
+        float near_plane = 0.1f;
+        bool cull_backfaces = false;
+        bool occlusion_culling = false;
+        bool two_phase_occlusion = false;
+        // 可见的点投影之后 w 的符号。这几次作业的投影矩阵 w = z，相机看 -z 方向，所以 w 是负的
+        float w_sign = 1;
+        draw_stats stats;
+
+        // setup_triangles 的结果，draw 的光栅化阶段用；放成成员是为了跨帧复用内存
+        int threads = 1;
+        worker_pool pool;
+        int tiles_x = 0, num_tiles = 0;
+        std::vector<vertex_output> vertices;
+        // 这次 draw 的三角形下标，指向调用者的索引缓冲，只在 draw 期间有效
+        const Eigen::Vector3i* triangles = nullptr;
+        int num_input_triangles = 0;
+        // 每个实例的顶点数和三角形数；不是实例化绘制时就是整个输入
+        int instance_vertices = 0, instance_triangles = 0;
+        // 近平面裁剪生成的三角形，顶点追加在 vertices 后面
+        std::vector<Eigen::Vector3i> clipped_triangles;
+        // 每个线程剔除、裁剪之后留下来的三角形，负数 -(k+1) 表示这个线程裁剪出来的第 k 个三角形
+        std::vector<std::vector<int>> survivors;
+        std::vector<std::vector<vertex_output>> thread_clip_vertices;
+        std::vector<std::vector<Eigen::Vector3i>> thread_clip_triangles;
+        // 用 TriangleList 画的时候，把三角形的顶点摊平到这些数组里再走索引绘制
+        std::vector<Eigen::Vector3f> list_positions, list_normals, list_colors;
+        std::vector<Eigen::Vector2f> list_tex_coords;
+        std::vector<Eigen::Vector3i> list_indices;
+        // bins[线程][块] 是这个线程负责的那段三角形里覆盖这个块的三角形下标
+        std::vector<std::vector<std::vector<int>>> bins;
+
+        // 当前深度缓冲的金字塔（hiz_dirty 表示之后又画过，用之前要重建）和上一帧的
+        depth_pyramid hiz, previous_hiz;
+        bool hiz_dirty = false;
+        // 每个 (位置缓冲, 索引缓冲) 的簇包围盒，第一次打开遮挡剔除画的时候算；TriangleList 每次重算
+        std::map<std::pair<int, int>, std::vector<Eigen::AlignedBox3f>> cluster_bounds;
+        std::vector<Eigen::AlignedBox3f> list_clusters;
+        // 两阶段剔除第一遍推迟到第二遍的：deferred_instances[k] 是 1 表示整个实例推迟，2 表示只推迟了一部分簇，
+        // deferred_clusters[k * 每个实例的簇数 + c] 是推迟的簇
+        std::vector<char> deferred_instances, deferred_clusters;
+        bool second_phase_pending = false;
+
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
+
+    namespace detail
+    {
+        // 屏幕坐标转成 24.8 定点数（1/256 像素），边函数全部用整数算，共边的两个三角形在边上的判断严格互补
+        constexpr int subpixel_bits = 8;
+        constexpr int64_t subpixel_one = 1 << subpixel_bits;
+        // 分层遍历的块大小，一行 block_size 个像素一起算边函数
+        constexpr int block_size = 8;
+        // 保护带：屏幕坐标在这个范围内的三角形不做屏幕边缘的裁剪，只把包围盒夹到屏幕上；
+        // 超出的（贴着近平面的巨大三角形）才对保护带的边裁剪，定点乘法不会溢出
+        constexpr float guard_band = 1 << 20;
+
+        // 齐次空间的裁剪面，clip_code 里一个面一位
+        constexpr int clip_near = 1;
+        constexpr int clip_left = 2;
+        constexpr int clip_right = 4;
+        constexpr int clip_bottom = 8;
+        constexpr int clip_top = 16;
+        // 三角形每对一个面裁剪最多多一个顶点
+        constexpr int max_clip_vertices = 3 + 5;
+
+        // 遮挡剔除时索引缓冲里连续的这么多个三角形算一簇，一起用包围盒判断
+        constexpr int cluster_triangles = 128;
+        // 包围盒的角和三角形的顶点各自舍入，深度差这么一点以内的不算挡住
+        constexpr float hiz_epsilon = 1e-4f;
+
+        /**
+         * @brief 边函数 E(x, y) = a*x + b*y + c，x、y 是定点坐标，三角形内部 E > 0
+         * top-left 规则：像素中心正好落在边上时，只有上边和左边算覆盖，
+         * 所以内部的判断是 E >= min_value，上/左边 min_value = 0，其他边是 1
+         */
+        struct Edge
+        {
+            int64_t a, b, c;
+            int64_t min_value;
+
+            int64_t at(int64_t x, int64_t y) const { return a * x + b * y + c; }
+        };
+
+        /**
+         * @brief Get the z interpolated object
+         * alpha，beta，gamma 是屏幕空间的重心坐标
+         * Zt = 1 / ( alpha/Za + beta/Zb + gamma/Zc )
+         * 这里的Za，Zb和Zc都是相机坐标下的数值，所以v[i].w()需要保留相机坐标下的z的信息
+         * 但是这次的作业里面w里面没有保留z的信息...
+         */
+        inline float get_z_interpolated(float alpha, float beta, float gamma, const std::array<Eigen::Vector4f, 3>& v)
+        {
+            // 计算对应的z，这里要做深度缓存判断
+            // depth_buf初始化的是设定了全部是infinity
+            float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
+            float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
+            // 这里z_interpolated计算出来对应的是真实的z
+            z_interpolated *= w_reciprocal;
+            // 这里为了方便判断depth_buf，直接用负数处理
+            z_interpolated = -z_interpolated;
+            return z_interpolated;
+        }
+
+        // 这里是做了简化版的插值处理，没有考虑到深度矫正的
+        inline Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f& vert1, const Eigen::Vector3f& vert2, const Eigen::Vector3f& vert3, float weight)
+        {
+            return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
+        }
+
+        inline Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const Eigen::Vector2f& vert1, const Eigen::Vector2f& vert2, const Eigen::Vector2f& vert3, float weight)
+        {
+            auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
+            auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
+
+            u /= weight;
+            v /= weight;
+
+            return Eigen::Vector2f(u, v);
+        }
+
+        // 纹理坐标对屏幕 x、y 的偏导。插值是屏幕空间线性的，所以整个三角形上是常数，
+        // 和 quad 里相邻像素做差得到的一样；延迟着色时像素没有 quad 邻居，用这个
+        inline void tex_coord_gradient(const std::array<Eigen::Vector4f, 3>& v, const std::array<Eigen::Vector2f, 3>& tex_coords,
+                                       Eigen::Vector2f& duv_dx, Eigen::Vector2f& duv_dy)
+        {
+            float x0 = v[0].x(), y0 = v[0].y();
+            float e1x = v[1].x() - x0, e1y = v[1].y() - y0;
+            float e2x = v[2].x() - x0, e2y = v[2].y() - y0;
+            float area = e1x * e2y - e1y * e2x;
+            if (area == 0)
+            {
+                duv_dx = duv_dy = Eigen::Vector2f::Zero();
+                return;
+            }
+            Eigen::Vector2f du1 = tex_coords[1] - tex_coords[0], du2 = tex_coords[2] - tex_coords[0];
+            // beta 对 x、y 的偏导是 (e2y, -e2x) / area，gamma 是 (-e1y, e1x) / area
+            duv_dx = (du1 * e2y - du2 * e1y) / area;
+            duv_dy = (du2 * e1x - du1 * e2x) / area;
+        }
+    }
+
+    template <typename FS>
+    void rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, const FS& frag_shader)
+    {
+        draw_indexed(buffer_input(pos_buffer, ind_buffer, col_buffer), frag_shader);
+    }
+
+    template <typename FS>
+    void rasterizer::draw(std::vector<Triangle *> &TriangleList, const FS& frag_shader)
+    {
+        draw_indexed(triangle_list_input(TriangleList), frag_shader);
+    }
+
+    template <typename FS>
+    void rasterizer::draw_instanced(pos_buf_id pos_buffer, ind_buf_id ind_buffer,
+                                    const std::vector<Eigen::Matrix4f>& instances, const FS& frag_shader)
+    {
+        // 空列表什么都不画；不能往下走，instances.data() 为空指针时 setup_triangles 会当成非实例化画一次
+        if (instances.empty())
+        {
+            stats = draw_stats{};
+            return;
+        }
+        vertex_input input = buffer_input(pos_buffer, ind_buffer, col_buf_id{-1});
+        input.instances = instances.data();
+        input.num_instances = instances.size();
+        draw_indexed(input, frag_shader);
+    }
+
+    /**
+     * @brief 一次 draw：不做两阶段剔除时只有一遍；
+     * 两阶段时第一遍跳过上一帧的金字塔判断被挡住的实例和簇，画完重建金字塔，
+     * 第二遍只处理第一遍推迟的那些，用这一帧的深度重新判断
+     */
+    template <typename FS>
+    void rasterizer::draw_indexed(const vertex_input& input, const FS& frag_shader)
+    {
+        if (occlusion_culling)
+            update_depth_pyramid();
+        bool two_phase = occlusion_culling && two_phase_occlusion && !previous_hiz.empty;
+        stats = draw_pass(input, frag_shader, two_phase ? 1 : 0);
+        if (two_phase && second_phase_pending)
+        {
+            update_depth_pyramid();
+            stats += draw_pass(input, frag_shader, 2);
+        }
+        triangles = nullptr;
+    }
+
+    /**
+     * @brief 流水线走一遍：setup_triangles 之后是光栅化 + 着色（sort-middle 的第 3 段）
+     * 线程按块领取，块内按提交顺序光栅化，只写块内的像素；
+     * 块与块之间没有共享的像素，深度测试的结果和单线程逐个画完全一样。
+     * 延迟模式下再多一遍：按行领取，每个可见像素只调用一次 frag_shader
+     * @param phase 见 setup_triangles
+     * @return 这一遍的统计；两遍时 visible 各算各的，第二遍盖掉第一遍的像素会算两次
+     */
+    template <typename FS>
+    draw_stats rasterizer::draw_pass(const vertex_input& input, const FS& frag_shader, int phase)
+    {
+        using clock = std::chrono::steady_clock;
+        auto elapsed_ms = [](clock::time_point since) {
+            return std::chrono::duration<double, std::milli>(clock::now() - since).count();
+        };
+        auto start = clock::now();
+        draw_stats totals = setup_triangles(input, phase);
+        totals.vertex_ms = elapsed_ms(start);
+
+        start = clock::now();
+        std::fill(id_buf.begin(), id_buf.end(), -1);
+
+        std::vector<draw_stats> thread_stats(threads);
+        std::atomic<int> next_tile{0};
+        run_workers([&](int thread_id) {
+            for (int tile = next_tile++; tile < num_tiles; tile = next_tile++)
+            {
+                int x0 = tile % tiles_x * tile_size, y0 = tile / tiles_x * tile_size;
+                int x1 = std::min(x0 + tile_size, width), y1 = std::min(y0 + tile_size, height);
+                for (int bin = 0; bin < threads; ++bin)
+                    for (int i : bins[bin][tile])
+                        // Also pass view space vertice position
+                        rasterize_triangle(frag_shader, triangle(i), i, x0, y0, x1, y1, thread_stats[thread_id]);
+            }
+        });
+        totals.raster_ms = elapsed_ms(start);
+        hiz_dirty = true;
+
+        start = clock::now();
+        if (deferred)
+        {
+            std::atomic<int> next_row{0};
+            run_workers([&](int thread_id) {
+                for (int y = next_row++; y < height; y = next_row++)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        int index = get_index(x, y);
+                        int i = id_buf[index];
+                        if (i < 0)
+                            continue;
+                        float beta = bary_buf[index].x(), gamma = bary_buf[index].y();
+                        const Eigen::Vector3i& tri = triangle(i);
+                        Eigen::Vector2f duv_dx, duv_dy;
+                        detail::tex_coord_gradient(
+                            {vertices[tri[0]].screen, vertices[tri[1]].screen, vertices[tri[2]].screen},
+                            {vertices[tri[0]].tex_coords, vertices[tri[1]].tex_coords, vertices[tri[2]].tex_coords},
+                            duv_dx, duv_dy);
+                        frame_buf[index] = shade_fragment(frag_shader, tri, 1 - beta - gamma, beta, gamma, duv_dx, duv_dy);
+                        ++thread_stats[thread_id].shaded;
+                    }
+                }
+            });
+        }
+        totals.fragment_ms = elapsed_ms(start);
+
+        for (auto& s : thread_stats)
+            totals += s;
+        totals.visible = std::count_if(id_buf.begin(), id_buf.end(), [](int i) { return i >= 0; });
+        return totals;
+    }
+
+    /**
+     * @brief Screen space rasterization
+     * 只处理 [x0, x1) x [y0, y1) 这个块里的像素，块由 draw 分配给各个线程
+     * 定点边函数 + 8x8 分块：整块在某条边外面直接跳过，整块在三条边里面就不用逐像素判断，
+     * 只有跨边的块才逐像素算覆盖。边函数按像素增量累加，同时也就是没有归一化的重心坐标。
+     * 块内再按 2x2 的 quad 着色：quad 里没被覆盖的像素也插值纹理坐标（不着色），
+     * 相邻像素做差得到纹理坐标的屏幕空间导数，给纹理选 mip 用。
+     * 通过深度测试的片元同时写进可见性缓冲；延迟模式下到这里为止，着色留给 draw 的最后一遍
+     */
+    template <typename FS>
+    void rasterizer::rasterize_triangle(const FS& frag_shader, const Eigen::Vector3i& tri, int tri_id,
+                                        int x0, int y0, int x1, int y1, draw_stats& tile_stats)
+    {
+        using namespace detail;
+        const vertex_output* verts[3] = {&vertices[tri[0]], &vertices[tri[1]], &vertices[tri[2]]};
+        std::array<Eigen::Vector4f, 3> v = {verts[0]->screen, verts[1]->screen, verts[2]->screen};
+
+        int min_x, min_y, max_x, max_y;
+        if (!screen_bounds(tri, min_x, min_y, max_x, max_y))
+            return;
+        min_x = std::max(min_x, x0);
+        min_y = std::max(min_y, y0);
+        max_x = std::min(max_x, x1 - 1);
+        max_y = std::min(max_y, y1 - 1);
+        if (min_x > max_x || min_y > max_y)
+            return;
+
+        int64_t X[3], Y[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            // 超出保护带的在分箱之前已经裁剪过了，这里主要是把 NaN 挡掉
+            if (!(std::abs(v[k].x()) < guard_band && std::abs(v[k].y()) < guard_band))
+                return;
+            X[k] = std::llround(v[k].x() * subpixel_one);
+            Y[k] = std::llround(v[k].y() * subpixel_one);
+        }
+        int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+        if (area == 0)
+            return;
+        // 原来的 insideTriangle 两种绕序都画，这里把顺时针的三角形换成逆时针，
+        // idx[k] 记下第 k 条边对面的顶点原来的下标，插值属性时用
+        int idx[3] = {0, 1, 2};
+        if (area < 0)
+        {
+            std::swap(idx[1], idx[2]);
+            area = -area;
+        }
+        Edge edge[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            int i = idx[(k + 1) % 3], j = idx[(k + 2) % 3];
+            edge[k].a = Y[i] - Y[j];
+            edge[k].b = X[j] - X[i];
+            edge[k].c = X[i] * Y[j] - Y[i] * X[j];
+            // 屏幕坐标 y 向上，逆时针绕序下往下走的边是左边，水平往左走的边是上边
+            bool top_left = Y[j] < Y[i] || (Y[j] == Y[i] && X[j] < X[i]);
+            edge[k].min_value = top_left ? 0 : 1;
+        }
+        float inv_area = 1.0f / area;
+
+        // 块内一行 block_size 个像素相对行首的边函数增量，固定长度的数组方便编译器向量化
+        int64_t offset[3][block_size];
+        for (int k = 0; k < 3; ++k)
+            for (int i = 0; i < block_size; ++i)
+                offset[k][i] = edge[k].a * subpixel_one * i;
+
+        // quad 从偶数坐标开始，和块的划分无关，同一个像素在哪个块里画导数都一样
+        int start_x = min_x & ~1, start_y = min_y & ~1;
+        for (int by = start_y; by <= max_y; by += block_size)
+        {
+            for (int bx = start_x; bx <= max_x; bx += block_size)
+            {
+                int bw = std::min(block_size, max_x - bx + 1), bh = std::min(block_size, max_y - by + 1);
+                // 像素中心 (x+0.5, y+0.5)
+                int64_t px = bx * subpixel_one + subpixel_one / 2, py = by * subpixel_one + subpixel_one / 2;
+                int64_t span_x = (bw - 1) * subpixel_one, span_y = (bh - 1) * subpixel_one;
+
+                // 边函数是线性的，块内像素中心的最大/最小值一定在四个角上
+                bool reject = false, accept = true;
+                int64_t row[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    const Edge& e = edge[k];
+                    row[k] = e.at(px, py);
+                    int64_t lo = row[k] + std::min<int64_t>(e.a * span_x, 0) + std::min<int64_t>(e.b * span_y, 0);
+                    int64_t hi = row[k] + std::max<int64_t>(e.a * span_x, 0) + std::max<int64_t>(e.b * span_y, 0);
+                    reject |= hi < e.min_value;
+                    accept &= lo >= e.min_value;
+                }
+                if (reject)
+                    continue;
+
+                // 整块的边函数值（quad 要用到未覆盖像素的值）和覆盖掩码；块外、包围盒外的像素不算覆盖
+                int64_t w[block_size][3][block_size];
+                bool inside[block_size][block_size];
+                int rows = std::min(block_size, (bh + 1) & ~1);
+                for (int r = 0; r < rows; ++r)
+                {
+                    int y = by + r;
+                    for (int k = 0; k < 3; ++k)
+                        for (int i = 0; i < block_size; ++i)
+                            w[r][k][i] = row[k] + offset[k][i];
+                    for (int i = 0; i < block_size; ++i)
+                        inside[r][i] = accept | ((w[r][0][i] >= edge[0].min_value) & (w[r][1][i] >= edge[1].min_value) &
+                                                 (w[r][2][i] >= edge[2].min_value));
+                    for (int i = 0; i < block_size; ++i)
+                        inside[r][i] &= bx + i >= min_x && bx + i <= max_x && y >= min_y && y <= max_y;
+                    for (int k = 0; k < 3; ++k)
+                        row[k] += edge[k].b * subpixel_one;
+                }
+
+                for (int qy = 0; qy < rows; qy += 2)
+                {
+                    for (int qx = 0; qx < bw; qx += 2)
+                    {
+                        // quad 里的 4 个像素：0 (x, y)，1 (x+1, y)，2 (x, y+1)，3 (x+1, y+1)
+                        bool live[4];
+                        float bary[4][3];
+                        float z[4];
+                        bool any = false;
+                        for (int q = 0; q < 4; ++q)
+                        {
+                            int r = qy + (q >> 1), i = qx + (q & 1);
+                            live[q] = false;
+                            for (int k = 0; k < 3; ++k)
+                                bary[q][idx[k]] = w[r][k][i] * inv_area;
+                            if (!inside[r][i])
+                                continue;
+                            ++tile_stats.covered;
+                            // alpha 由另外两个推出来，和可见性缓冲里只存 beta、gamma 的做法一致，两种模式的结果逐位相同
+                            bary[q][0] = 1 - bary[q][1] - bary[q][2];
+                            z[q] = get_z_interpolated(bary[q][0], bary[q][1], bary[q][2], v);
+                            int index = get_index(bx + i, by + r);
+                            // 当前z的比旧的小，需要进行更新
+                            if (z[q] >= depth_buf[index])
+                                continue;
+                            ++tile_stats.depth_passed;
+                            depth_buf[index] = z[q];
+                            id_buf[index] = tri_id;
+                            bary_buf[index] = Eigen::Vector2f(bary[q][1], bary[q][2]);
+                            live[q] = true;
+                            any = true;
+                        }
+                        if (!any || deferred)
+                            continue;
+
+                        Eigen::Vector2f uv[4];
+                        for (int q = 0; q < 4; ++q)
+                            uv[q] = interpolate(bary[q][0], bary[q][1], bary[q][2], verts[0]->tex_coords, verts[1]->tex_coords, verts[2]->tex_coords, 1);
+                        Eigen::Vector2f duv_dx = uv[1] - uv[0], duv_dy = uv[2] - uv[0];
+                        for (int q = 0; q < 4; ++q)
+                        {
+                            if (!live[q])
+                                continue;
+                            int index = get_index(bx + qx + (q & 1), by + qy + (q >> 1));
+                            frame_buf[index] = shade_fragment(frag_shader, tri, bary[q][0], bary[q][1], bary[q][2],
+                                                              duv_dx, duv_dy);
+                            ++tile_stats.shaded;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // 插值顶点属性并调用着色器，前向和延迟两条路径共用
+    template <typename FS>
+    Eigen::Vector3f rasterizer::shade_fragment(const FS& frag_shader, const Eigen::Vector3i& tri, float alpha,
+                                               float beta, float gamma, const Eigen::Vector2f& duv_dx,
+                                               const Eigen::Vector2f& duv_dy)
+    {
+        using detail::interpolate;
+        const vertex_output& a = vertices[tri[0]];
+        const vertex_output& b = vertices[tri[1]];
+        const vertex_output& c = vertices[tri[2]];
+        auto interpolated_color = interpolate(alpha, beta, gamma, a.color, b.color, c.color, 1);
+        auto interpolated_normal = interpolate(alpha, beta, gamma, a.normal, b.normal, c.normal, 1);
+        auto interpolated_tangent = interpolate(alpha, beta, gamma, a.tangent, b.tangent, c.tangent, 1);
+        auto interpolated_texcoords = interpolate(alpha, beta, gamma, a.tex_coords, b.tex_coords, c.tex_coords, 1);
+        auto interpolated_shadingcoords = interpolate(alpha, beta, gamma, a.view_pos, b.view_pos, c.view_pos, 1);
+        fragment_shader_payload payload = fragment_shader_payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
+        payload.view_pos = interpolated_shadingcoords;
+        payload.tangent = interpolated_tangent;
+        payload.duv_dx = duv_dx;
+        payload.duv_dy = duv_dy;
+        return frag_shader(payload);
+    }
 }
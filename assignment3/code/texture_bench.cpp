@@ -0,0 +1,112 @@
+// 纹理取样的微基准：同一批纹理坐标，比较各种取样方式平均每次多少纳秒
+// 用法：TextureBench [纹理路径] [每种方式的取样次数]
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Texture.hpp"
+
+namespace
+{
+// 改之前 getColorBilinear 的做法：每个纹素一次 cv::Mat::at 再转成 float（坐标这里夹紧了，原来是不夹的）
+Eigen::Vector3f mat_bilinear(const cv::Mat& image, float u, float v)
+{
+    auto at = [&](float x, float y) {
+        auto color = image.at<cv::Vec3b>(std::clamp((int)y, 0, image.rows - 1), std::clamp((int)x, 0, image.cols - 1));
+        return Eigen::Vector3f(color[0], color[1], color[2]);
+    };
+    float u_img = u * image.cols, v_img = (1 - v) * image.rows;
+    float s = u_img - std::floor(u_img), t = v_img - std::floor(v_img);
+    Eigen::Vector3f c0 = at(std::floor(u_img), std::floor(v_img)) * (1 - s) + at(std::ceil(u_img), std::floor(v_img)) * s;
+    Eigen::Vector3f c1 = at(std::floor(u_img), std::ceil(v_img)) * (1 - s) + at(std::ceil(u_img), std::ceil(v_img)) * s;
+    return c0 * (1 - t) + c1 * t;
+}
+
+struct Query
+{
+    float u, v;
+    Eigen::Vector2f duv_dx, duv_dy;
+};
+
+// coherent：像光栅化一样按行扫过纹理，相邻两次取样在纹理上相邻；random：完全随机
+// scale 是一个像素覆盖多少个第 0 层纹素，aspect 是足迹长短轴之比
+std::vector<Query> make_queries(int count, bool coherent, float scale, float aspect, int width, int height)
+{
+    std::vector<Query> queries(count);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    int row = 512;
+    for (int i = 0; i < count; ++i)
+    {
+        Query& q = queries[i];
+        q.duv_dx = Eigen::Vector2f(scale * aspect / width, 0);
+        q.duv_dy = Eigen::Vector2f(0, scale / height);
+        if (coherent)
+        {
+            q.u = (i % row) * q.duv_dx.x();
+            q.v = (i / row % row) * q.duv_dy.y();
+            q.u -= std::floor(q.u);
+            q.v -= std::floor(q.v);
+        }
+        else
+        {
+            q.u = uniform(rng);
+            q.v = uniform(rng);
+        }
+    }
+    return queries;
+}
+
+template <typename F>
+void run(const std::string& name, const std::vector<Query>& queries, F&& fetch)
+{
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    auto start = std::chrono::steady_clock::now();
+    for (const Query& q : queries)
+        sum += fetch(q);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    // 把结果打出来，免得整个循环被优化掉
+    std::cout << "  " << name << ": " << ns / queries.size() << " ns/fetch (checksum " << sum.sum() << ")\n";
+}
+}
+
+int main(int argc, const char** argv)
+{
+    std::string path = argc >= 2 ? argv[1] : "../models/spot/spot_texture.png";
+    int count = argc >= 3 ? std::stoi(argv[2]) : 1 << 20;
+
+    auto start = std::chrono::steady_clock::now();
+    Texture texture(path);
+    std::cout << path << ": " << texture.width << "x" << texture.height << ", " << texture.levels()
+              << " mip levels, built in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms\n";
+    cv::Mat image = cv::imread(path);
+
+    struct Case
+    {
+        const char* name;
+        bool coherent;
+        float scale, aspect;
+    };
+    Case cases[] = {
+        {"coherent, magnified (0.5 texel/pixel)", true, 0.5f, 1},
+        {"coherent, minified (4 texels/pixel)", true, 4, 1},
+        {"coherent, anisotropic 8:1", true, 1, 8},
+        {"random", false, 1, 1},
+    };
+    for (const Case& c : cases)
+    {
+        std::cout << c.name << "\n";
+        auto queries = make_queries(count, c.coherent, c.scale, c.aspect, texture.width, texture.height);
+        run("cv::Mat bilinear (old)", queries, [&](const Query& q) { return mat_bilinear(image, q.u, q.v); });
+        run("nearest", queries, [&](const Query& q) { return texture.getColor(q.u, q.v); });
+        run("bilinear", queries, [&](const Query& q) { return texture.getColorBilinear(q.u, q.v); });
+        texture.max_anisotropy = 1;
+        run("trilinear", queries, [&](const Query& q) { return texture.sample(q.u, q.v, q.duv_dx, q.duv_dy); });
+        texture.max_anisotropy = 8;
+        run("anisotropic x8", queries, [&](const Query& q) { return texture.sample(q.u, q.v, q.duv_dx, q.duv_dy); });
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 针孔相机，fov 是竖直视角（度）。默认在原点朝 -z 看，这时 direction() 和原来 Render 的主光线逐位相同
+struct Camera
+{
+    Vector3f eye = Vector3f(0);
+    Vector3f target = Vector3f(0, 0, -1);
+    Vector3f up = Vector3f(0, 1, 0);
+    float fov = 90;
+
+    void prepare(int w, int h)
+    {
+        width = w;
+        height = h;
+        forward = normalize(target - eye);
+        Vector3f side = crossProduct(forward, up);
+        // up 和视线平行（比如从正上方往下看）时叉积是 0，换一个和视线不平行的轴
+        if (dotProduct(side, side) < 1e-12f * dotProduct(up, up))
+            side = crossProduct(forward, std::fabs(forward.z) < 0.9f ? Vector3f(0, 0, 1) : Vector3f(1, 0, 0));
+        right = normalize(side);
+        upDir = crossProduct(right, forward);
+        float halfFov = fov * 0.5f * M_PI / 180.0;
+        scale = std::tan(halfFov);
+        imageAspectRatio = w / (float)h;
+    }
+
+    // 像素 (i, j) 中心的主光线方向（已归一化），prepare() 之后才能用
+    Vector3f direction(int i, int j) const
+    {
+        float ndcx = (i + 0.5f) / (float)width;
+        float ndcy = (j + 0.5f) / (float)height;
+        float x = (2 * ndcx - 1) * imageAspectRatio * scale;
+        float y = (1 - 2 * ndcy) * scale;
+        return normalize(forward + right * x + upDir * y);
+    }
+
+private:
+    int width = 1, height = 1;
+    Vector3f forward, right, upDir;
+    float scale = 1, imageAspectRatio = 1;
+};
+
+// 绕 start.target 所在的竖直轴转一圈，等分成 frames 帧；第 0 帧就是 start
+inline std::vector<Camera> Turntable(const Camera& start, int frames)
+{
+    std::vector<Camera> cameras;
+    Vector3f offset = start.eye - start.target;
+    for (int f = 0; f < frames; ++f) {
+        float angle = 2 * M_PI * f / frames;
+        float c = std::cos(angle), s = std::sin(angle);
+        Camera camera = start;
+        camera.eye = start.target + Vector3f(offset.x * c + offset.z * s, offset.y, -offset.x * s + offset.z * c);
+        cameras.push_back(camera);
+    }
+    return cameras;
+}
+
+// 相机路径文件：每行 "ex ey ez tx ty tz [fov]"，空行和 # 开头的行跳过；没写 fov 的行用 defaultFov。
+// 打不开文件时返回空数组
+inline std::vector<Camera> LoadCameraPath(const std::string& filename, float defaultFov)
+{
+    std::vector<Camera> cameras;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream in(line);
+        Camera camera;
+        camera.fov = defaultFov;
+        if (!(in >> camera.eye.x >> camera.eye.y >> camera.eye.z >> camera.target.x >> camera.target.y >>
+              camera.target.z))
+            continue;
+        float fov;
+        if (in >> fov)
+            camera.fov = fov;
+        cameras.push_back(camera);
+    }
+    return cameras;
+}
@@ -0,0 +1,251 @@
+#include "Grid.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+inline float axis(const Vector3f& v, int a)
+{
+    return a == 0 ? v.x : (a == 1 ? v.y : v.z);
+}
+
+// 直接映射的 mailbox：按全局图元编号取槽位，冲突时顶掉旧的，最多导致重复求交一次，不影响正确性
+constexpr uint32_t mailboxSize = 256;
+
+struct Mailbox
+{
+    uint32_t prim[mailboxSize] = {};
+    uint32_t ray[mailboxSize] = {};
+};
+
+thread_local Mailbox mailbox;
+thread_local uint32_t lastRayId = 0;
+
+uint32_t nextRayId()
+{
+    if (++lastRayId == 0) {
+        // 编号回绕了，清空旧记录以免误判
+        mailbox = Mailbox();
+        lastRayId = 1;
+    }
+    return lastRayId;
+}
+} // namespace
+
+Grid::Grid(const std::vector<std::unique_ptr<Object> >& objects, bool twoLevel)
+{
+    std::vector<PrimRef> refs;
+    std::vector<Bounds> primBounds;
+    for (const auto& object : objects) {
+        for (uint32_t k = 0; k < object->numPrimitives(); ++k) {
+            Bounds b;
+            object->getPrimitiveBounds(k, b.pMin, b.pMax);
+            bounds.pMin = Vector3f(std::min(bounds.pMin.x, b.pMin.x), std::min(bounds.pMin.y, b.pMin.y),
+                                   std::min(bounds.pMin.z, b.pMin.z));
+            bounds.pMax = Vector3f(std::max(bounds.pMax.x, b.pMax.x), std::max(bounds.pMax.y, b.pMax.y),
+                                   std::max(bounds.pMax.z, b.pMax.z));
+            refs.push_back({object.get(), k, (uint32_t)primBounds.size()});
+            primBounds.push_back(b);
+        }
+    }
+    primitiveCount = refs.size();
+    if (refs.empty())
+        return;
+
+    // 平面网格（比如 main 里的地板）在某个轴上厚度为 0，稍微撑开一点，避免格子尺寸为 0
+    Vector3f extent = bounds.pMax - bounds.pMin;
+    float pad = std::max(1e-4f, 1e-3f * std::max(extent.x, std::max(extent.y, extent.z)));
+    bounds.pMin = bounds.pMin - Vector3f(pad);
+    bounds.pMax = bounds.pMax + Vector3f(pad);
+
+    build(refs, primBounds, twoLevel);
+}
+
+Grid::Grid(const std::vector<PrimRef>& refs, const std::vector<Bounds>& primBounds, const Bounds& box)
+{
+    bounds = box;
+    primitiveCount = refs.size();
+    build(refs, primBounds, false);
+}
+
+void Grid::build(const std::vector<PrimRef>& refs, const std::vector<Bounds>& primBounds, bool subdivide)
+{
+    // 分辨率按 Cleary & Wyvill 的经验公式：每轴 extent * cbrt(density * N / V)
+    Vector3f extent = bounds.pMax - bounds.pMin;
+    float volume = extent.x * extent.y * extent.z;
+    float cellsPerUnit = std::cbrt(density * refs.size() / volume);
+    for (int a = 0; a < 3; ++a)
+        resolution[a] = std::clamp((int)(axis(extent, a) * cellsPerUnit), 1, maxResolution);
+    cellSize = Vector3f(extent.x / resolution[0], extent.y / resolution[1], extent.z / resolution[2]);
+    invCellSize = Vector3f(1 / cellSize.x, 1 / cellSize.y, 1 / cellSize.z);
+
+    size_t cellCount = (size_t)resolution[0] * resolution[1] * resolution[2];
+
+    // 图元包围盒覆盖的格子范围，两遍：先数每格多少个，再按前缀和填进去
+    auto cellRange = [&](const PrimRef& ref, int lo[3], int hi[3]) {
+        const Bounds& b = primBounds[ref.id];
+        for (int a = 0; a < 3; ++a) {
+            float origin = axis(bounds.pMin, a), inv = axis(invCellSize, a);
+            lo[a] = std::clamp((int)((axis(b.pMin, a) - origin) * inv), 0, resolution[a] - 1);
+            hi[a] = std::clamp((int)((axis(b.pMax, a) - origin) * inv), 0, resolution[a] - 1);
+        }
+    };
+    auto forEachCell = [&](const PrimRef& ref, auto&& f) {
+        int lo[3], hi[3];
+        cellRange(ref, lo, hi);
+        for (int z = lo[2]; z <= hi[2]; ++z)
+            for (int y = lo[1]; y <= hi[1]; ++y)
+                for (int x = lo[0]; x <= hi[0]; ++x)
+                    f(((size_t)z * resolution[1] + y) * resolution[0] + x);
+    };
+
+    cellStart.assign(cellCount + 1, 0);
+    for (const auto& ref : refs)
+        forEachCell(ref, [&](size_t c) { ++cellStart[c + 1]; });
+    for (size_t c = 0; c < cellCount; ++c)
+        cellStart[c + 1] += cellStart[c];
+    cellRefs.resize(cellStart[cellCount]);
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (const auto& ref : refs)
+        forEachCell(ref, [&](size_t c) { cellRefs[fill[c]++] = ref; });
+    referenceCount = cellRefs.size();
+
+    cellSubgrid.assign(cellCount, -1);
+    if (!subdivide)
+        return;
+    for (int z = 0; z < resolution[2]; ++z)
+        for (int y = 0; y < resolution[1]; ++y)
+            for (int x = 0; x < resolution[0]; ++x) {
+                size_t c = ((size_t)z * resolution[1] + y) * resolution[0] + x;
+                if (cellStart[c + 1] - cellStart[c] <= subgridThreshold)
+                    continue;
+                Bounds box;
+                box.pMin = bounds.pMin + cellSize * Vector3f(x, y, z);
+                box.pMax = box.pMin + cellSize;
+                std::vector<PrimRef> local(cellRefs.begin() + cellStart[c], cellRefs.begin() + cellStart[c + 1]);
+                auto child = std::unique_ptr<Grid>(new Grid(local, primBounds, box));
+                if (child->resolution[0] * child->resolution[1] * child->resolution[2] == 1)
+                    continue;
+                referenceCount += child->referenceCount;
+                cellSubgrid[c] = subgrids.size();
+                subgrids.push_back(std::move(child));
+            }
+    subgridCount = subgrids.size();
+}
+
+// 光线和网格包围盒求交（slab 法），把 [t0, t1] 裁剪到盒子里面的那一段
+bool Grid::clip(const Vector3f& orig, const Vector3f& invDir, float& t0, float& t1) const
+{
+    for (int a = 0; a < 3; ++a) {
+        float o = axis(orig, a), inv = axis(invDir, a);
+        float lo = axis(bounds.pMin, a), hi = axis(bounds.pMax, a);
+        if (std::isinf(inv)) {
+            // 方向在这个轴上是 0：原点不在 slab 里就一定不相交
+            if (o < lo || o > hi)
+                return false;
+            continue;
+        }
+        float tNear = (lo - o) * inv, tFar = (hi - o) * inv;
+        if (tNear > tFar)
+            std::swap(tNear, tFar);
+        // 放宽一点远端，和 pbrt 一样防止擦边的光线因为舍入被判成不相交
+        tFar *= 1 + 6 * std::numeric_limits<float>::epsilon();
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+// 3D-DDA (Amanatides & Woo)：每一步走到 tNext 最小的那个轴的相邻格子
+void Grid::traverse(const Vector3f& orig, const Vector3f& dir, const Vector3f& invDir, uint32_t rayId,
+                    float tMin, float tMax, Hit& hit) const
+{
+    float t0 = tMin, t1 = tMax;
+    if (!clip(orig, invDir, t0, t1))
+        return;
+
+    int cell[3], step[3], out[3];
+    float tNext[3], tDelta[3];
+    for (int a = 0; a < 3; ++a) {
+        float o = axis(orig, a), d = axis(dir, a), inv = axis(invDir, a);
+        float lo = axis(bounds.pMin, a), size = axis(cellSize, a);
+        float p = o + d * t0;
+        cell[a] = std::clamp((int)((p - lo) * axis(invCellSize, a)), 0, resolution[a] - 1);
+        if (d > 0) {
+            step[a] = 1;
+            out[a] = resolution[a];
+            tNext[a] = (lo + (cell[a] + 1) * size - o) * inv;
+            tDelta[a] = size * inv;
+        }
+        else if (d < 0) {
+            step[a] = -1;
+            out[a] = -1;
+            tNext[a] = (lo + cell[a] * size - o) * inv;
+            tDelta[a] = -size * inv;
+        }
+        else {
+            step[a] = 0;
+            out[a] = -1;
+            tNext[a] = kInfinity;
+            tDelta[a] = kInfinity;
+        }
+    }
+
+    while (true) {
+        size_t c = ((size_t)cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+        int a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        float tExit = std::min(tNext[a], t1);
+
+        if (cellSubgrid[c] >= 0) {
+            // 子网格的盒子就是这个格子，让它自己裁剪，不传累加出来的 tEntry/tExit，免得浮点误差把擦边的光线裁掉
+            subgrids[cellSubgrid[c]]->traverse(orig, dir, invDir, rayId, 0, kInfinity, hit);
+        }
+        else {
+            for (uint32_t r = cellStart[c]; r < cellStart[c + 1]; ++r) {
+                const PrimRef& ref = cellRefs[r];
+                uint32_t slot = ref.id & (mailboxSize - 1);
+                if (mailbox.ray[slot] == rayId && mailbox.prim[slot] == ref.id)
+                    continue;
+                mailbox.ray[slot] = rayId;
+                mailbox.prim[slot] = ref.id;
+
+                float t = kInfinity;
+                Vector2f uv;
+                if (ref.object->intersectPrimitive(ref.prim, orig, dir, t, uv) && t < hit.tNear) {
+                    hit.tNear = t;
+                    hit.index = ref.prim;
+                    hit.uv = uv;
+                    hit.object = ref.object;
+                }
+            }
+        }
+
+        // 交点已经落在当前格子之内（或更近），后面的格子不可能更近
+        if (hit.tNear <= tExit || tNext[a] > t1)
+            return;
+        cell[a] += step[a];
+        if (cell[a] == out[a])
+            return;
+        tNext[a] += tDelta[a];
+    }
+}
+
+bool Grid::intersect(const Vector3f& orig, const Vector3f& dir, float& tNear, uint32_t& index, Vector2f& uv,
+                     Object*& hitObject) const
+{
+    if (primitiveCount == 0)
+        return false;
+    Vector3f invDir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+    Hit hit;
+    traverse(orig, dir, invDir, nextRayId(), 0, kInfinity, hit);
+    if (!hit.object)
+        return false;
+    tNear = hit.tNear;
+    index = hit.index;
+    uv = hit.uv;
+    hitObject = hit.object;
+    return true;
+}
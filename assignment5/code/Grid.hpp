@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Object.hpp"
+#include "Vector.hpp"
+
+// @brief 均匀网格加速结构
+// 把所有物体拆成图元（三角形、球），按包围盒登记到覆盖的每个格子里（CSR 紧凑存储）。
+// 求交时用 3D-DDA 沿光线逐格前进，某格里找到的最近交点 t 不超过这一格的出口 t 就可以停。
+// 一个图元会出现在多个格子里，用线程局部的 mailbox 记下“这条光线已经测过它”，避免重复求交。
+// twoLevel 打开时，图元特别多的格子里再建一层子网格（只嵌套一层），对分布不均匀的场景更友好。
+class Grid
+{
+public:
+    struct Bounds
+    {
+        Vector3f pMin = Vector3f(kInfinity);
+        Vector3f pMax = Vector3f(-kInfinity);
+    };
+
+    struct PrimRef
+    {
+        Object* object;
+        uint32_t prim;
+        uint32_t id; // 全局图元编号，用作 mailbox 的键
+    };
+
+    Grid(const std::vector<std::unique_ptr<Object> >& objects, bool twoLevel = false);
+
+    // 和 Renderer.cpp 里暴力 trace() 的输出一致：最近交点的 t、图元下标、重心坐标和物体
+    bool intersect(const Vector3f& orig, const Vector3f& dir, float& tNear, uint32_t& index, Vector2f& uv,
+                   Object*& hitObject) const;
+
+    // 格子总数约为 density * 图元数，即每个图元约 3 个格子（Cleary & Wyvill / pbrt 的经验值）
+    static constexpr float density = 3.0f;
+    // 超过这个数量的格子在两层模式下会细分
+    static constexpr uint32_t subgridThreshold = 24;
+    static constexpr int maxResolution = 128;
+
+    int resolution[3] = {1, 1, 1};
+    uint32_t primitiveCount = 0;
+    size_t referenceCount = 0;
+    size_t subgridCount = 0;
+
+private:
+    struct Hit
+    {
+        float tNear = kInfinity;
+        uint32_t index = 0;
+        Vector2f uv;
+        Object* object = nullptr;
+    };
+
+    Grid(const std::vector<PrimRef>& refs, const std::vector<Bounds>& primBounds, const Bounds& box);
+
+    void build(const std::vector<PrimRef>& refs, const std::vector<Bounds>& primBounds, bool subdivide);
+    bool clip(const Vector3f& orig, const Vector3f& invDir, float& t0, float& t1) const;
+    void traverse(const Vector3f& orig, const Vector3f& dir, const Vector3f& invDir, uint32_t rayId,
+                  float tMin, float tMax, Hit& hit) const;
+
+    Bounds bounds;
+    Vector3f cellSize;
+    Vector3f invCellSize;
+    // 第 c 个格子的图元是 cellRefs[cellStart[c], cellStart[c + 1])
+    std::vector<uint32_t> cellStart;
+    std::vector<PrimRef> cellRefs;
+    // 细分过的格子在 subgrids 里的下标，没有细分的是 -1
+    std::vector<int> cellSubgrid;
+    std::vector<std::unique_ptr<Grid> > subgrids;
+};
@@ -27,6 +27,19 @@ public:
         return diffuseColor;
     }
 
+    // 给 Grid 用的图元接口：一个物体由 numPrimitives() 个图元组成（球是 1 个，网格是每个三角形一个），
+    // 每个图元能单独求包围盒、单独求交，这样网格里的三角形才能分散到不同的格子里
+    virtual uint32_t numPrimitives() const { return 1; }
+
+    virtual void getPrimitiveBounds(uint32_t, Vector3f& pMin, Vector3f& pMax) const = 0;
+
+    virtual bool intersectPrimitive(uint32_t, const Vector3f& orig, const Vector3f& dir, float& tnear,
+                                    Vector2f& uv) const
+    {
+        uint32_t index;
+        return intersect(orig, dir, tnear, index, uv);
+    }
+
     // material properties
     MaterialType materialType;
     float ior;
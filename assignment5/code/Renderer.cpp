@@ -3,9 +3,13 @@
 #include "Renderer.hpp"
 #include "Scene.hpp"
 #include <optional>
-
-inline float deg2rad(const float &deg)
-{ return deg * M_PI/180.0; }
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 // Compute reflection direction
 Vector3f reflect(const Vector3f &I, const Vector3f &N)
@@ -73,7 +77,7 @@ float fresnel(const Vector3f &I, const Vector3f &N, const float &ior)
 //
 // \param orig is the ray origin
 // \param dir is the ray direction
-// \param objects is the list of objects the scene contains
+// \param scene is the scene; its grid is used when one has been built
 // \param[out] tNear contains the distance to the cloesest intersected object.
 // \param[out] index stores the index of the intersect triangle if the interesected object is a mesh.
 // \param[out] uv stores the u and v barycentric coordinates of the intersected point
@@ -81,12 +85,18 @@ float fresnel(const Vector3f &I, const Vector3f &N, const float &ior)
 // \param isShadowRay is it a shadow ray. We can return from the function sooner as soon as we have found a hit.
 // [/comment]
 std::optional<hit_payload> trace(
-        const Vector3f &orig, const Vector3f &dir,
-        const std::vector<std::unique_ptr<Object> > &objects)
+        const Vector3f &orig, const Vector3f &dir, const Scene& scene)
 {
     float tNear = kInfinity;
     std::optional<hit_payload> payload;
-    for (const auto & object : objects)
+    if (const Grid* grid = scene.get_grid())
+    {
+        hit_payload hit;
+        if (grid->intersect(orig, dir, hit.tNear, hit.index, hit.uv, hit.hit_obj))
+            payload = hit;
+        return payload;
+    }
+    for (const auto & object : scene.get_objects())
     {
         float tNearK = kInfinity;
         uint32_t indexK;
@@ -109,30 +119,63 @@ std::optional<hit_payload> trace(
 // Implementation of the Whitted-style light transport algorithm (E [S*] (D|G) L)
 //
 // This function is the function that compute the color at the intersection point
-// of a ray defined by a position and a direction. Note that thus function is recursive (it calls itself).
+// of a ray defined by a position and a direction.
 //
 // If the material of the intersected object is either reflective or reflective and refractive,
-// then we compute the reflection/refraction direction and cast two new rays into the scene
-// by calling the castRay() function recursively. When the surface is transparent, we mix
-// the reflection and refraction color using the result of the fresnel equations (it computes
-// the amount of reflection and refraction depending on the surface normal, incident view direction
-// and surface refractive index).
+// then we compute the reflection/refraction direction and cast two new rays into the scene.
+// When the surface is transparent, we mix the reflection and refraction color using the result
+// of the fresnel equations (it computes the amount of reflection and refraction depending on
+// the surface normal, incident view direction and surface refractive index).
 //
 // If the surface is diffuse/glossy we use the Phong illumation model to compute the color
 // at the intersection point.
+//
+// 原来是递归实现：透明物体每一层都同时递归反射和折射两条光线，深度 maxDepth 时是 2^depth 棵满树，
+// 哪怕某个分支最后只乘上很小的 kr。现在改成显式栈迭代：栈里每条光线带着它对像素的累计权重
+// （沿路径 kr / (1 - kr) 的乘积），颜色直接按权重累加到像素上；权重的最大分量不超过
+// scene.contributionThreshold 的分支直接剪掉，不再求交。
 // [/comment]
 Vector3f castRay(
-        const Vector3f &orig, const Vector3f &dir, const Scene& scene,
-        int depth)
+        const Vector3f &primaryOrig, const Vector3f &primaryDir, const Scene& scene,
+        RayStats &stats)
 {
-    if (depth > scene.maxDepth) {
-        return Vector3f(0.0,0.0,0.0);
-    }
+    struct RayTask
+    {
+        Vector3f orig, dir;
+        Vector3f weight;
+        int depth;
+    };
+    // 每弹出一条光线最多压入两条，深度不超过 maxDepth + 1，所以栈的大小是有界的
+    thread_local std::vector<RayTask> stack;
+    stack.clear();
+    stack.push_back({primaryOrig, primaryDir, Vector3f(1), 0});
+
+    auto spawn = [&](const Vector3f &o, const Vector3f &d, const Vector3f &weight, int depth) {
+        if (std::max(weight.x, std::max(weight.y, weight.z)) <= scene.contributionThreshold) {
+            ++stats.pruned;
+            return;
+        }
+        stack.push_back({o, d, weight, depth});
+    };
 
-    Vector3f hitColor = scene.backgroundColor;
-    if (auto payload = trace(orig, dir, scene.get_objects()); payload)
+    Vector3f pixelColor = 0;
+    while (!stack.empty())
     {
-        Vector3f hitPoint = orig + dir * payload->tNear;
+        RayTask task = stack.back();
+        stack.pop_back();
+        if (task.depth > scene.maxDepth) {
+            continue;
+        }
+
+        ++stats.rays;
+        auto payload = trace(task.orig, task.dir, scene);
+        if (!payload) {
+            pixelColor += task.weight * scene.backgroundColor;
+            continue;
+        }
+
+        const Vector3f &dir = task.dir;
+        Vector3f hitPoint = task.orig + dir * payload->tNear;
         Vector3f N; // normal
         Vector2f st; // st coordinates
         payload->hit_obj->getSurfaceProperties(hitPoint, dir, payload->index, payload->uv, N, st);
@@ -147,10 +190,9 @@ Vector3f castRay(
                 Vector3f refractionRayOrig = (dotProduct(refractionDirection, N) < 0) ?
                                              hitPoint - N * scene.epsilon :
                                              hitPoint + N * scene.epsilon;
-                Vector3f reflectionColor = castRay(reflectionRayOrig, reflectionDirection, scene, depth + 1);
-                Vector3f refractionColor = castRay(refractionRayOrig, refractionDirection, scene, depth + 1);
                 float kr = fresnel(dir, N, payload->hit_obj->ior);
-                hitColor = reflectionColor * kr + refractionColor * (1 - kr);
+                spawn(refractionRayOrig, refractionDirection, task.weight * (1 - kr), task.depth + 1);
+                spawn(reflectionRayOrig, reflectionDirection, task.weight * kr, task.depth + 1);
                 break;
             }
             case REFLECTION:
@@ -161,7 +203,7 @@ Vector3f castRay(
                 Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, N) < 0) ?
                                              hitPoint + N * scene.epsilon :
                                              hitPoint - N * scene.epsilon;
-                hitColor = castRay(reflectionRayOrig, reflectionDirection, scene, depth + 1) * kr;
+                spawn(reflectionRayOrig, reflectionDirection, task.weight * kr, task.depth + 1);
                 break;
             }
             default:
@@ -185,7 +227,8 @@ Vector3f castRay(
                     lightDir = normalize(lightDir);
                     float LdotN = std::max(0.f, dotProduct(lightDir, N));
                     // is the point in shadow, and is the nearest occluding object closer to the object than the light itself?
-                    auto shadow_res = trace(shadowPointOrig, lightDir, scene.get_objects());
+                    ++stats.shadowRays;
+                    auto shadow_res = trace(shadowPointOrig, lightDir, scene);
                     bool inShadow = shadow_res && (shadow_res->tNear * shadow_res->tNear < lightDistance2);
 
                     lightAmt += inShadow ? 0 : light->intensity * LdotN;
@@ -195,63 +238,214 @@ Vector3f castRay(
                         payload->hit_obj->specularExponent) * light->intensity;
                 }
 
-                hitColor = lightAmt * payload->hit_obj->evalDiffuseColor(st) * payload->hit_obj->Kd + specularColor * payload->hit_obj->Ks;
+                Vector3f hitColor = lightAmt * payload->hit_obj->evalDiffuseColor(st) * payload->hit_obj->Kd + specularColor * payload->hit_obj->Ks;
+                pixelColor += task.weight * hitColor;
                 break;
             }
         }
     }
 
-    return hitColor;
+    return pixelColor;
 }
 
-// [comment]
-// The main render function. This where we iterate over all pixels in the image, generate
-// primary rays and cast these rays into the scene. The content of the framebuffer is
-// saved to a file.
-// [/comment]
-void Renderer::Render(const Scene& scene)
+// 渲染一个块 [x0, x1) x [y0, y1) 的像素；rayCounts 为空时不记录每像素光线数
+void Renderer::renderTile(const Scene& scene, const Camera& camera, int x0, int y0, int x1, int y1,
+                          std::vector<Vector3f>& framebuffer, std::vector<uint32_t>* counts, RayStats& threadStats)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
-
-    float scale = std::tan(deg2rad(scene.fov * 0.5f));
-    float imageAspectRatio = scene.width / (float)scene.height;
-
-    // Use this variable as the eye position to start your rays.
-    Vector3f eye_pos(0);
-    int m = 0;
-    for (int j = 0; j < scene.height; ++j)
+    for (int j = y0; j < y1; ++j)
     {
-        for (int i = 0; i < scene.width; ++i)
+        for (int i = x0; i < x1; ++i)
         {
-            // generate primary ray direction
-            float x;
-            float y;
-            // TODO: Find the x and y positions of the current pixel to get the direction
-            // vector that passes through it.
-            // Also, don't forget to multiply both of them with the variable *scale*, and
-            // x (horizontal) variable with the *imageAspectRatio*            
-            float ndcx = (i + 0.5f) / (float)scene.width;
-            float ndcy = (j + 0.5f) / (float)scene.height;
-            x = ( 2 * ndcx - 1 ) * imageAspectRatio * scale;
-            y = ( 1 - 2 * ndcy ) * scale;
-            Vector3f dir = Vector3f(x, y, -1); // Don't forget to normalize this direction!
-            dir = normalize(dir);
-            framebuffer[m++] = castRay(eye_pos, dir, scene, 0);
+            RayStats pixelStats;
+            int m = j * scene.width + i;
+            framebuffer[m] = castRay(camera.eye, camera.direction(i, j), scene, pixelStats);
+            if (counts)
+                (*counts)[m] = pixelStats.rays + pixelStats.shadowRays;
+            threadStats.rays += pixelStats.rays;
+            threadStats.shadowRays += pixelStats.shadowRays;
+            threadStats.pruned += pixelStats.pruned;
         }
-        UpdateProgress(j / (float)scene.height);
     }
+}
 
-    // save framebuffer to file
-    FILE* fp = fopen("binary.ppm", "wb");
+static void writePPM(const std::string& filename, const Scene& scene, const std::vector<Vector3f>& framebuffer)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
     (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
     for (auto i = 0; i < scene.height * scene.width; ++i) {
         // unsigned char 0~255
         // char -128~+127
-        static unsigned char color[3];
+        unsigned char color[3];
         color[0] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].x));
         color[1] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].y));
         color[2] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].z));
         fwrite(color, 1, 3, fp);
     }
-    fclose(fp);    
+    fclose(fp);
+}
+
+// [comment]
+// The main render function. This where we iterate over all pixels in the image, generate
+// primary rays and cast these rays into the scene. The content of the framebuffer is
+// saved to a file.
+//
+// 图像切成 tileSize x tileSize 的块，numThreads 个工作线程用一个原子计数器动态领取块。
+// 每个像素的结果只取决于它自己的光线，所以输出和线程数、块大小无关。
+// 进度不再每行打印：工作线程只累加原子计数，主线程每 100ms 醒一次汇总打印。
+// [/comment]
+void Renderer::Render(const Scene& scene)
+{
+    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    stats = RayStats();
+    rayCounts.assign(scene.width * scene.height, 0);
+
+    // 默认相机：在原点朝 -z 看
+    Camera camera;
+    camera.fov = scene.fov;
+    camera.prepare(scene.width, scene.height);
+
+    int tile = std::max(1, tileSize);
+    int tilesX = (scene.width + tile - 1) / tile;
+    int tilesY = (scene.height + tile - 1) / tile;
+    int numTiles = tilesX * tilesY;
+    std::atomic<int> nextTile{0};
+    std::atomic<int> pixelsDone{0};
+    std::atomic<int> threadsDone{0};
+    std::mutex mtx;
+    std::condition_variable finished;
+
+    int threads = numThreads > 0 ? numThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (int k = 0; k < threads; ++k) {
+        workers.emplace_back([&]() {
+            RayStats threadStats;
+            for (int t = nextTile++; t < numTiles; t = nextTile++) {
+                int x0 = t % tilesX * tile, y0 = t / tilesX * tile;
+                int x1 = std::min(x0 + tile, scene.width), y1 = std::min(y0 + tile, scene.height);
+                renderTile(scene, camera, x0, y0, x1, y1, framebuffer, &rayCounts, threadStats);
+                pixelsDone += (x1 - x0) * (y1 - y0);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            stats.rays += threadStats.rays;
+            stats.shadowRays += threadStats.shadowRays;
+            stats.pruned += threadStats.pruned;
+            ++threadsDone;
+            finished.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!finished.wait_for(lock, std::chrono::milliseconds(100), [&] { return threadsDone == threads; }))
+            UpdateProgress(pixelsDone / (float)(scene.width * scene.height));
+    }
+    for (auto &w : workers)
+        w.join();
+    UpdateProgress(1.f);
+
+    // save framebuffer to file
+    writePPM("binary.ppm", scene, framebuffer);
+
+    if (writeRayCounts) {
+        uint32_t maxCount = *std::max_element(rayCounts.begin(), rayCounts.end());
+        FILE* fp = fopen("raycount.ppm", "wb");
+        (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
+        for (auto count : rayCounts) {
+            unsigned char v = (unsigned char)(255 * count / std::max(1u, maxCount));
+            unsigned char color[3] = {v, v, v};
+            fwrite(color, 1, 3, fp);
+        }
+        fclose(fp);
+    }
+}
+
+// 转台 / 相机路径：所有帧的块排进一个 (帧, 块) 队列，帧与帧之间不空等；
+// 做完的帧交给写图线程，帧缓冲第一次领块时分配、写完释放
+void Renderer::RenderFrames(const Scene& scene, std::vector<Camera> cameras, const std::string& pattern)
+{
+    struct Frame
+    {
+        std::once_flag allocated;
+        std::vector<Vector3f> pixels;
+        std::atomic<int> tilesLeft{0};
+    };
+
+    int numFrames = cameras.size();
+    stats = RayStats();
+    for (auto& camera : cameras)
+        camera.prepare(scene.width, scene.height);
+
+    int tile = std::max(1, tileSize);
+    int tilesX = (scene.width + tile - 1) / tile;
+    int tilesY = (scene.height + tile - 1) / tile;
+    int tilesPerFrame = tilesX * tilesY;
+    int numJobs = numFrames * tilesPerFrame;
+    std::vector<Frame> frames(numFrames);
+    for (auto& frame : frames)
+        frame.tilesLeft = tilesPerFrame;
+
+    std::atomic<int> nextJob{0};
+    std::atomic<int> tilesDone{0};
+    std::atomic<int> threadsDone{0};
+    std::mutex mtx;
+    std::condition_variable finished;
+
+    // 写图线程：等完成的帧号，写完释放帧缓冲
+    std::queue<int> readyFrames;
+    bool allRendered = false;
+    std::condition_variable frameReady;
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            frameReady.wait(lock, [&] { return !readyFrames.empty() || allRendered; });
+            if (readyFrames.empty())
+                return;
+            int f = readyFrames.front();
+            readyFrames.pop();
+            lock.unlock();
+            char filename[256];
+            snprintf(filename, sizeof(filename), pattern.c_str(), f);
+            writePPM(filename, scene, frames[f].pixels);
+            std::vector<Vector3f>().swap(frames[f].pixels);
+            lock.lock();
+        }
+    });
+
+    int threads = numThreads > 0 ? numThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (int k = 0; k < threads; ++k) {
+        workers.emplace_back([&]() {
+            RayStats threadStats;
+            for (int job = nextJob++; job < numJobs; job = nextJob++) {
+                int f = job / tilesPerFrame, t = job % tilesPerFrame;
+                Frame& frame = frames[f];
+                std::call_once(frame.allocated, [&] { frame.pixels.resize(scene.width * scene.height); });
+                int x0 = t % tilesX * tile, y0 = t / tilesX * tile;
+                int x1 = std::min(x0 + tile, scene.width), y1 = std::min(y0 + tile, scene.height);
+                renderTile(scene, cameras[f], x0, y0, x1, y1, frame.pixels, nullptr, threadStats);
+                ++tilesDone;
+                if (--frame.tilesLeft == 0) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    readyFrames.push(f);
+                    frameReady.notify_one();
+                }
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            stats.rays += threadStats.rays;
+            stats.shadowRays += threadStats.shadowRays;
+            stats.pruned += threadStats.pruned;
+            ++threadsDone;
+            finished.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!finished.wait_for(lock, std::chrono::milliseconds(100), [&] { return threadsDone == threads; }))
+            UpdateProgress(tilesDone / (float)numJobs);
+        allRendered = true;
+        frameReady.notify_one();
+    }
+    for (auto &w : workers)
+        w.join();
+    writer.join();
+    UpdateProgress(1.f);
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "Scene.hpp"
+#include "Camera.hpp"
+#include <string>
 
 struct hit_payload
 {
@@ -9,10 +11,34 @@ struct hit_payload
     Object* hit_obj;
 };
 
+// 光线树的统计：rays 是求交的主光线和反射/折射光线，shadowRays 是阴影光线，pruned 是因为权重太小被剪掉的分支
+struct RayStats
+{
+    uint64_t rays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t pruned = 0;
+};
+
 class Renderer
 {
 public:
     void Render(const Scene& scene);
+    // 依次渲染 cameras 里的每个相机，第 f 帧写到 printf(pattern, f)
+    void RenderFrames(const Scene& scene, std::vector<Camera> cameras,
+                      const std::string& pattern = "frame_%04d.ppm");
+
+    // 工作线程数，0 表示用 hardware_concurrency()
+    int numThreads = 0;
+    // 线程每次领取的块的边长（像素）
+    int tileSize = 16;
+
+    // 渲染完之后可以查看：整张图的统计，以及每个像素追踪的光线数（含阴影光线）
+    RayStats stats;
+    std::vector<uint32_t> rayCounts;
+    // 为 true 时额外输出 raycount.ppm，按每像素光线数画的灰度图（最亮 = 最多）
+    bool writeRayCounts = false;
 
 private:
+    void renderTile(const Scene& scene, const Camera& camera, int x0, int y0, int x1, int y1,
+                    std::vector<Vector3f>& framebuffer, std::vector<uint32_t>* counts, RayStats& threadStats);
 };
\ No newline at end of file
@@ -3,3 +3,8 @@
 //
 
 #include "Scene.hpp"
+
+void Scene::buildGrid(bool twoLevel)
+{
+    grid = std::make_unique<Grid>(objects, twoLevel);
+}
@@ -5,6 +5,7 @@
 #include "Vector.hpp"
 #include "Object.hpp"
 #include "Light.hpp"
+#include "Grid.hpp"
 
 class Scene
 {
@@ -16,6 +17,8 @@ public:
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
     int maxDepth = 5;
     float epsilon = 0.00001;
+    // 反射/折射分支累计权重的最大分量不超过它就不再追踪，0 表示只剪掉权重为 0 的分支
+    float contributionThreshold = 0.001;
 
     Scene(int w, int h) : width(w), height(h)
     {}
@@ -26,8 +29,13 @@ public:
     [[nodiscard]] const std::vector<std::unique_ptr<Object> >& get_objects() const { return objects; }
     [[nodiscard]] const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
 
+    // 物体都加完之后调用；建了网格以后 trace() 走网格，否则还是逐个物体暴力求交
+    void buildGrid(bool twoLevel = false);
+    [[nodiscard]] const Grid* get_grid() const { return grid.get(); }
+
 private:
     // creating the scene (adding objects and lights)
     std::vector<std::unique_ptr<Object> > objects;
     std::vector<std::unique_ptr<Light> > lights;
+    std::unique_ptr<Grid> grid;
 };
\ No newline at end of file
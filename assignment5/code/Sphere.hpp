@@ -31,6 +31,12 @@ public:
         return true;
     }
 
+    void getPrimitiveBounds(uint32_t, Vector3f& pMin, Vector3f& pMax) const override
+    {
+        pMin = center - Vector3f(radius);
+        pMax = center + Vector3f(radius);
+    }
+
     void getSurfaceProperties(const Vector3f& P, const Vector3f&, const uint32_t&, const Vector2f&,
                               Vector3f& N, Vector2f&) const override
     {
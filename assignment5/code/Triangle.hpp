@@ -5,7 +5,7 @@
 #include <cstring>
 // u和v是相交点的重心坐标的u和v 
 // PT Lecture 13 P29 的 Möller Trumbore Algorithm
-bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const Vector3f& orig,
+inline bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const Vector3f& orig,
                           const Vector3f& dir, float& tnear, float& u, float& v)
 {
     // TODO: Implement this function that tests whether the triangle
@@ -72,6 +72,31 @@ public:
         return intersect;
     }
 
+    uint32_t numPrimitives() const override { return numTriangles; }
+
+    void getPrimitiveBounds(uint32_t k, Vector3f& pMin, Vector3f& pMax) const override
+    {
+        pMin = pMax = vertices[vertexIndex[k * 3]];
+        for (uint32_t i = 1; i < 3; ++i)
+        {
+            const Vector3f& p = vertices[vertexIndex[k * 3 + i]];
+            pMin = Vector3f(std::min(pMin.x, p.x), std::min(pMin.y, p.y), std::min(pMin.z, p.z));
+            pMax = Vector3f(std::max(pMax.x, p.x), std::max(pMax.y, p.y), std::max(pMax.z, p.z));
+        }
+    }
+
+    bool intersectPrimitive(uint32_t k, const Vector3f& orig, const Vector3f& dir, float& tnear,
+                            Vector2f& uv) const override
+    {
+        float u, v;
+        if (!rayTriangleIntersect(vertices[vertexIndex[k * 3]], vertices[vertexIndex[k * 3 + 1]],
+                                  vertices[vertexIndex[k * 3 + 2]], orig, dir, tnear, u, v))
+            return false;
+        uv.x = u;
+        uv.y = v;
+        return true;
+    }
+
     void getSurfaceProperties(const Vector3f&, const Vector3f&, const uint32_t& index, const Vector2f& uv, Vector3f& N,
                               Vector2f& st) const override
     {
@@ -3,11 +3,14 @@
 #include "Triangle.hpp"
 #include "Light.hpp"
 #include "Renderer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <string>
 
 // In the main function of the program, we create the scene (create objects and lights)
 // as well as set the options for the render (image width and height, maximum recursion
 // depth, field-of-view, etc.). We then call the render function().
-int main()
+int main(int argc, char** argv)
 {
     Scene scene(1280, 960);
 
@@ -32,8 +35,72 @@ int main()
     scene.Add(std::make_unique<Light>(Vector3f(-20, 70, 20), 0.5));
     scene.Add(std::make_unique<Light>(Vector3f(30, 50, -12), 0.5));    
 
+    // --no-grid: 不建网格，trace() 逐个物体暴力求交（用来对比），--two-level: 密集的格子里再建子网格
+    // --threshold t: 反射/折射分支的剪枝阈值，--ray-counts: 输出每像素光线数的灰度图 raycount.ppm
+    // --threads N: 工作线程数（默认等于 CPU 核数），--tile N: 线程每次领取的块大小
+    // --turntable N: 绕场景中心转一圈渲染 N 帧，--camera-path file: 按文件里的相机逐帧渲染，都输出 frame_%04d.ppm
     Renderer r;
+    bool useGrid = true, twoLevel = false;
+    int turntableFrames = 0;
+    std::string cameraPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-grid")
+            useGrid = false;
+        else if (arg == "--two-level")
+            twoLevel = true;
+        else if (arg == "--threshold" && i + 1 < argc)
+            scene.contributionThreshold = std::stof(argv[++i]);
+        else if (arg == "--ray-counts")
+            r.writeRayCounts = true;
+        else if (arg == "--threads" && i + 1 < argc)
+            r.numThreads = std::stoi(argv[++i]);
+        else if (arg == "--tile" && i + 1 < argc)
+            r.tileSize = std::stoi(argv[++i]);
+        else if (arg == "--turntable" && i + 1 < argc)
+            turntableFrames = std::stoi(argv[++i]);
+        else if (arg == "--camera-path" && i + 1 < argc)
+            cameraPath = argv[++i];
+    }
+    if (useGrid) {
+        scene.buildGrid(twoLevel);
+        const Grid& grid = *scene.get_grid();
+        printf("Grid: %u primitives, %d x %d x %d cells, %zu references, %zu subgrids\n", grid.primitiveCount,
+               grid.resolution[0], grid.resolution[1], grid.resolution[2], grid.referenceCount, grid.subgridCount);
+    }
+
+    if (turntableFrames > 0 || !cameraPath.empty()) {
+        std::vector<Camera> cameras;
+        if (!cameraPath.empty()) {
+            cameras = LoadCameraPath(cameraPath, scene.fov);
+        }
+        else {
+            // 从默认视角出发，绕两个球之间的竖直轴转
+            Camera start;
+            start.target = Vector3f(0, 0, -10);
+            start.fov = scene.fov;
+            cameras = Turntable(start, turntableFrames);
+        }
+        if (cameras.empty()) {
+            std::cerr << "no cameras to render\n";
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        r.RenderFrames(scene, cameras);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("\n%zu frames in %.2f s (%.3f s/frame)\n", cameras.size(), seconds, seconds / cameras.size());
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
     r.Render(scene);
+    printf("\nRender time: %.2f s\n",
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    double pixels = scene.width * scene.height;
+    printf("Rays per pixel: %.2f (%.2f shadow), max %u, %llu branches pruned below %g\n",
+           (r.stats.rays + r.stats.shadowRays) / pixels, r.stats.shadowRays / pixels,
+           *std::max_element(r.rayCounts.begin(), r.rayCounts.end()), (unsigned long long)r.stats.pruned,
+           scene.contributionThreshold);
 
     return 0;
 }
\ No newline at end of file
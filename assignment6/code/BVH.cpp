@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include "BVH.hpp"
 
 BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
@@ -9,10 +10,16 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
 {
     time_t start, stop;
     time(&start);
+    root = nullptr;
     if (primitives.empty())
         return;
 
-    root = recursiveBuild(primitives);
+    // 叶子按建树的顺序把图元重新放回 primitives
+    auto buildStart = std::chrono::steady_clock::now();
+    std::vector<Object *> input;
+    input.swap(primitives);
+    root = recursiveBuild(input);
+    buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
 
     time(&stop);
     double diff = difftime(stop, start);
@@ -25,28 +32,41 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
         hrs, mins, secs);
 }
 
-BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
+BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects, int depth)
 {
     // printf(" - recursiveBuild BVH...\n\n");
     BVHBuildNode *node = new BVHBuildNode();
+    nodeCount++;
+    maxDepth = std::max(maxDepth, depth);
 
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
-    for (int i = 0; i < objects.size(); ++i)
+    for (size_t i = 0; i < objects.size(); ++i)
         bounds = Union(bounds, objects[i]->getBounds());
-    if (objects.size() == 1)
+    if (objects.size() <= (size_t)maxPrimsInNode)
     {
-        // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
+        // Create leaf _BVHBuildNode_，最多 maxPrimsInNode 个图元连续存放
+        node->bounds = bounds;
         node->object = objects[0];
         node->left = nullptr;
         node->right = nullptr;
+        node->firstPrimOffset = primitives.size();
+        node->nPrimitives = objects.size();
+        node->packedTriangles = true;
+        for (auto object : objects)
+        {
+            LeafTriangle tri;
+            node->packedTriangles &= object->getTriangle(tri.v0, tri.e1, tri.e2, tri.normal);
+            primitives.push_back(object);
+            leafTriangles.push_back(tri);
+        }
+        leafCount++;
         return node;
     }
     else if (objects.size() == 2)
     {
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
+        node->left = recursiveBuild(std::vector{objects[0]}, depth + 1);
+        node->right = recursiveBuild(std::vector{objects[1]}, depth + 1);
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
         return node;
@@ -55,10 +75,11 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
     {
         // 判断哪个轴的“长度”更长？
         Bounds3 centroidBounds;
-        for (int i = 0; i < objects.size(); ++i)
+        for (size_t i = 0; i < objects.size(); ++i)
             centroidBounds =
                 Union(centroidBounds, objects[i]->getBounds().Centroid());
         int dim = centroidBounds.maxExtent();
+        node->splitAxis = dim;
         // 选择一个维度作为排序根据
         switch (dim)
         {
@@ -82,14 +103,16 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
         auto beginning = objects.begin();
         auto middling = objects.begin() + (objects.size() / 2);
         auto ending = objects.end();
+        if (splitMethod == SplitMethod::SAH)
+            middling = beginning + sahSplit(objects, dim, centroidBounds, bounds);
         // 左右分离
         auto leftshapes = std::vector<Object *>(beginning, middling);
         auto rightshapes = std::vector<Object *>(middling, ending);
 
         assert(objects.size() == (leftshapes.size() + rightshapes.size()));
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
+        node->left = recursiveBuild(leftshapes, depth + 1);
+        node->right = recursiveBuild(rightshapes, depth + 1);
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
     }
@@ -97,6 +120,144 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
     return node;
 }
 
+/**
+ * @brief
+ * 分桶的 SAH（和 pbrt 一样 12 个桶）：objects 已经沿 dim 按质心排好序，
+ * 在桶的边界里选代价 0.125 + (N_l * S_l + N_r * S_r) / S 最小的位置，返回左边的图元个数。
+ * 质心都重合或者某一边为空时退回到中位数划分
+ */
+int BVHAccel::sahSplit(const std::vector<Object *> &objects, int dim, const Bounds3 &centroidBounds,
+                       const Bounds3 &bounds) const
+{
+    constexpr int nBuckets = 12;
+    int median = objects.size() / 2;
+    float lo = centroidBounds.pMin[dim], hi = centroidBounds.pMax[dim];
+    if (hi <= lo)
+        return median;
+
+    int count[nBuckets] = {0};
+    Bounds3 bucketBounds[nBuckets];
+    auto bucketOf = [&](Object *object) {
+        const Vector3f centroid = object->getBounds().Centroid();
+        float c = centroid[dim];
+        return std::min(nBuckets - 1, (int)(nBuckets * (c - lo) / (hi - lo)));
+    };
+    for (auto object : objects)
+    {
+        int b = bucketOf(object);
+        count[b]++;
+        bucketBounds[b] = Union(bucketBounds[b], object->getBounds());
+    }
+
+    // 从右往左累积出每个划分位置右边的包围盒，再从左往右扫一遍
+    Bounds3 rightBounds[nBuckets];
+    int rightCount[nBuckets] = {0};
+    Bounds3 acc;
+    int accCount = 0;
+    for (int b = nBuckets - 1; b > 0; --b)
+    {
+        acc = Union(acc, bucketBounds[b]);
+        accCount += count[b];
+        rightBounds[b] = acc;
+        rightCount[b] = accCount;
+    }
+    float bestCost = std::numeric_limits<float>::max();
+    int bestSplit = -1, leftCount = 0;
+    Bounds3 leftBounds;
+    for (int b = 1; b < nBuckets; ++b)
+    {
+        leftBounds = Union(leftBounds, bucketBounds[b - 1]);
+        leftCount += count[b - 1];
+        if (leftCount == 0 || rightCount[b] == 0)
+            continue;
+        float cost = 0.125f + (leftCount * leftBounds.SurfaceArea() + rightCount[b] * rightBounds[b].SurfaceArea()) /
+                                  bounds.SurfaceArea();
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = leftCount;
+        }
+    }
+    return bestSplit > 0 ? bestSplit : median;
+}
+
+static void deleteNodes(BVHBuildNode *node)
+{
+    if (node == nullptr)
+        return;
+    deleteNodes(node->left);
+    deleteNodes(node->right);
+    delete node;
+}
+
+BVHAccel::~BVHAccel()
+{
+    deleteNodes(root);
+}
+
+size_t BVHAccel::memoryBytes() const
+{
+    return nodeCount * sizeof(BVHBuildNode) + primitives.size() * sizeof(Object *) +
+           leafTriangles.size() * sizeof(LeafTriangle);
+}
+
+/**
+ * @brief
+ * 叶子求交。全是三角形的叶子先在连续的 leafTriangles 上用和 Triangle::getIntersection
+ * 完全相同的算术找到最近的那个，最后只对它调用一次虚函数生成 Intersection；
+ * 否则逐个调用 getIntersection
+ */
+Intersection BVHAccel::intersectLeaf(const BVHBuildNode *node, const Ray &ray) const
+{
+    traversalStats.primitivesTested += node->nPrimitives;
+    int begin = node->firstPrimOffset, end = begin + node->nPrimitives;
+    if (!node->packedTriangles)
+    {
+        Intersection closest;
+        for (int k = begin; k < end; ++k)
+        {
+            Intersection hit = primitives[k]->getIntersection(ray);
+            if (hit.distance <= closest.distance)
+                closest = hit;
+        }
+        return closest;
+    }
+
+    int best = -1;
+    double bestT = std::numeric_limits<double>::max();
+    for (int k = begin; k < end; ++k)
+    {
+        const LeafTriangle &tri = leafTriangles[k];
+        if (dotProduct(ray.direction, tri.normal) > 0)
+            continue;
+        Vector3f pvec = crossProduct(ray.direction, tri.e2);
+        double det = dotProduct(tri.e1, pvec);
+        if (fabs(det) < EPSILON)
+            continue;
+        double det_inv = 1. / det;
+        Vector3f tvec = ray.origin - tri.v0;
+        double u = dotProduct(tvec, pvec) * det_inv;
+        if (u < 0 || u > 1)
+            continue;
+        Vector3f qvec = crossProduct(tvec, tri.e1);
+        double v = dotProduct(ray.direction, qvec) * det_inv;
+        if (v < 0 || u + v > 1)
+            continue;
+        double t = dotProduct(tri.e2, qvec) * det_inv;
+        if (t < 0)
+            continue;
+        // 和原来一个图元一个叶子时一样，距离相同的取后面那个（getIntersection 里 left/right 相等时取 right）
+        if (t <= bestT)
+        {
+            bestT = t;
+            best = k;
+        }
+    }
+    if (best < 0)
+        return {};
+    return primitives[best]->getIntersection(ray);
+}
+
 Intersection BVHAccel::Intersect(const Ray &ray) const
 {
     // printf(" - BVHAccel start...\n\n");
@@ -110,6 +271,7 @@ Intersection BVHAccel::Intersect(const Ray &ray) const
 Intersection BVHAccel::getIntersection(BVHBuildNode *node, const Ray &ray) const
 {
     // TODO Traverse the BVH to find intersection
+    traversalStats.nodesVisited++;
 
     Vector3f invDir(1.0 / ray.direction.x, 1.0 / ray.direction.y, 1.0 / ray.direction.z);
 
@@ -126,11 +288,86 @@ Intersection BVHAccel::getIntersection(BVHBuildNode *node, const Ray &ray) const
     // 如果碰撞盒不再继续细分，测试碰撞盒内的所有物体是否与光线相交，返回最早相交的
     if (node->left == nullptr && node->right == nullptr)
     {
-        return node->object->getIntersection(ray);
+        return intersectLeaf(node, ray);
     }
 
     // 测试细分的碰撞盒
     Intersection left = BVHAccel::getIntersection(node->left, ray);
     Intersection right = BVHAccel::getIntersection(node->right, ray);
     return left.distance < right.distance ? left : right;
-}
\ No newline at end of file
+}
+void BVHAccel::IntersectPacket(const RayPacket &packet, uint32_t mask, Intersection *hits) const
+{
+    if (!root)
+        return;
+    if (!packet.coherent()) {
+        // 方向不一致的包直接逐条追踪
+        for (size_t k = 0; k < packet.rays.size(); ++k) {
+            if (!(mask >> k & 1))
+                continue;
+            Intersection hit = getIntersection(root, packet.rays[k]);
+            if (hit.distance < hits[k].distance)
+                hits[k] = hit;
+        }
+        return;
+    }
+    getIntersectionPacket(root, packet, mask, hits);
+}
+
+void BVHAccel::getIntersectionPacket(BVHBuildNode *node, const RayPacket &packet, uint32_t mask, Intersection *hits) const
+{
+    traversalStats.nodesVisited++;
+    if (packet.culls(node->bounds))
+        return;
+
+    // 逐条光线做 slab 测试，已经找到更近交点的光线不再进入这个节点
+    uint32_t active = 0;
+    for (size_t k = 0; k < packet.rays.size(); ++k) {
+        if (!(mask >> k & 1))
+            continue;
+        const Ray &ray = packet.rays[k];
+        Vector3f t0 = (node->bounds.pMin - ray.origin) * ray.direction_inv;
+        Vector3f t1 = (node->bounds.pMax - ray.origin) * ray.direction_inv;
+        float tenter = std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)), std::min(t0.z, t1.z));
+        float texit = std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)), std::max(t0.z, t1.z));
+        if (tenter < texit && texit >= 0 && tenter < hits[k].distance)
+            active |= 1u << k;
+    }
+    if (active == 0)
+        return;
+
+    if (node->left == nullptr && node->right == nullptr) {
+        if (node->packedTriangles) {
+            for (size_t k = 0; k < packet.rays.size(); ++k) {
+                if (!(active >> k & 1))
+                    continue;
+                Intersection hit = intersectLeaf(node, packet.rays[k]);
+                if (hit.distance < hits[k].distance)
+                    hits[k] = hit;
+            }
+        } else {
+            for (int k = node->firstPrimOffset; k < node->firstPrimOffset + node->nPrimitives; ++k)
+                primitives[k]->getIntersectionPacket(packet, active, hits);
+        }
+        return;
+    }
+
+    if (__builtin_popcount(active) < PACKET_MIN_ACTIVE) {
+        for (size_t k = 0; k < packet.rays.size(); ++k) {
+            if (!(active >> k & 1))
+                continue;
+            Intersection hit = getIntersection(node, packet.rays[k]);
+            if (hit.distance < hits[k].distance)
+                hits[k] = hit;
+        }
+        return;
+    }
+
+    // 包里方向同号，按 splitAxis 上的方向先走近的子节点，远的那个更容易被 hits 剪掉
+    const Vector3f &d = packet.rays[0].direction;
+    float dirOnAxis = node->splitAxis == 0 ? d.x : (node->splitAxis == 1 ? d.y : d.z);
+    BVHBuildNode *nearChild = dirOnAxis < 0 ? node->right : node->left;
+    BVHBuildNode *farChild = dirOnAxis < 0 ? node->left : node->right;
+    getIntersectionPacket(nearChild, packet, active, hits);
+    getIntersectionPacket(farChild, packet, active, hits);
+}
@@ -13,6 +13,7 @@
 #include "Ray.hpp"
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
+#include "RayPacket.hpp"
 #include "Vector.hpp"
 
 struct BVHBuildNode;
@@ -21,6 +22,20 @@ struct BVHPrimitiveInfo;
 
 // BVHAccel Declarations
 inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
+
+// 每个线程各自累加的遍历统计，Renderer 在线程结束时汇总
+struct TraversalStats
+{
+    uint64_t rays = 0, nodesVisited = 0, primitivesTested = 0;
+};
+inline thread_local TraversalStats traversalStats;
+
+// 叶子里的三角形连续存放，求交时不用逐个走虚函数
+struct LeafTriangle
+{
+    Vector3f v0, e1, e2, normal;
+};
+
 class BVHAccel {
 
 public:
@@ -35,15 +50,30 @@ public:
     Intersection Intersect(const Ray &ray) const;
     Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
     bool IntersectP(const Ray &ray) const;
+    // 一包光线共用一次遍历：视锥剔除 + 逐条 slab 测试得到活跃 mask，活跃光线太少时退回单光线
+    void IntersectPacket(const RayPacket &packet, uint32_t mask, Intersection *hits) const;
+    void getIntersectionPacket(BVHBuildNode* node, const RayPacket &packet, uint32_t mask, Intersection *hits) const;
     BVHBuildNode* root;
 
     // BVHAccel Private Methods
-    BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    BVHBuildNode* recursiveBuild(std::vector<Object*>objects, int depth = 0);
+    // SAH 划分时左边的图元个数
+    int sahSplit(const std::vector<Object*>& objects, int dim, const Bounds3& centroidBounds, const Bounds3& bounds) const;
+    // 叶子里所有图元求交，返回最近的交点
+    Intersection intersectLeaf(const BVHBuildNode* node, const Ray& ray) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    // 按叶子顺序重排过，叶子用 [firstPrimOffset, firstPrimOffset + nPrimitives) 引用
     std::vector<Object*> primitives;
+    // 和 primitives 一一对应，只有整个叶子都是三角形时才会被用到
+    std::vector<LeafTriangle> leafTriangles;
+
+    // 树的统计信息
+    int nodeCount = 0, leafCount = 0, maxDepth = 0;
+    double buildSeconds = 0;
+    size_t memoryBytes() const;
 };
 
 struct BVHBuildNode {
@@ -54,6 +84,8 @@ struct BVHBuildNode {
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0;
+    // 叶子里全是三角形，可以直接用 leafTriangles 求交
+    bool packedTriangles = false;
     // BVHBuildNode Public Methods
     BVHBuildNode(){
         bounds = Bounds3();
@@ -0,0 +1,240 @@
+//
+// Standalone BVH quality report: builds BVHAccel over one or more OBJ files
+// for every split method / leaf size and writes the statistics as JSON.
+//
+
+#include <fstream>
+#include <random>
+#include <map>
+#include "Triangle.hpp"
+
+// Renderer.cpp 里定义的常量，这个工具不链接 Renderer
+const float EPSILON = 0.00001;
+
+// SAH 里一次节点遍历和一次三角形求交的相对代价
+static const double kTraversalCost = 1.0, kIntersectCost = 1.0;
+
+struct TreeStats
+{
+    double sahCost = 0;
+    double epo = 0;
+    std::vector<int> leafDepthHistogram, leafSizeHistogram;
+};
+
+static float length(const Vector3f &v)
+{
+    return std::sqrt(dotProduct(v, v));
+}
+
+static bool contains(const Bounds3 &b, const Vector3f &p)
+{
+    return p.x >= b.pMin.x && p.x <= b.pMax.x && p.y >= b.pMin.y && p.y <= b.pMax.y && p.z >= b.pMin.z &&
+           p.z <= b.pMax.z;
+}
+
+static double nodeCost(const BVHBuildNode *node)
+{
+    return node->nPrimitives > 0 ? kIntersectCost * node->nPrimitives : kTraversalCost;
+}
+
+// 叶子按深度优先的顺序排在 primitives 里，所以每棵子树对应一段连续的下标 [first, last)
+static void subtreeRanges(BVHBuildNode *node, std::map<const BVHBuildNode *, std::pair<int, int>> &ranges)
+{
+    if (node->left == nullptr && node->right == nullptr) {
+        ranges[node] = {node->firstPrimOffset, node->firstPrimOffset + node->nPrimitives};
+        return;
+    }
+    subtreeRanges(node->left, ranges);
+    subtreeRanges(node->right, ranges);
+    ranges[node] = {ranges[node->left].first, ranges[node->right].second};
+}
+
+static void collect(const BVHBuildNode *node, int depth, double rootArea, TreeStats &stats)
+{
+    stats.sahCost += nodeCost(node) * node->bounds.SurfaceArea() / rootArea;
+    if (node->left == nullptr && node->right == nullptr) {
+        if (stats.leafDepthHistogram.size() <= (size_t)depth)
+            stats.leafDepthHistogram.resize(depth + 1);
+        if (stats.leafSizeHistogram.size() <= (size_t)node->nPrimitives)
+            stats.leafSizeHistogram.resize(node->nPrimitives + 1);
+        stats.leafDepthHistogram[depth]++;
+        stats.leafSizeHistogram[node->nPrimitives]++;
+        return;
+    }
+    collect(node->left, depth + 1, rootArea, stats);
+    collect(node->right, depth + 1, rootArea, stats);
+}
+
+// 样本点 p 落在三角形 prim 上：累加所有包含 p、但子树里没有 prim 的节点的代价
+static double epoAt(const BVHBuildNode *node, const Vector3f &p, int prim,
+                    const std::map<const BVHBuildNode *, std::pair<int, int>> &ranges)
+{
+    if (!contains(node->bounds, p))
+        return 0;
+    const auto &range = ranges.at(node);
+    double cost = (prim < range.first || prim >= range.second) ? nodeCost(node) : 0;
+    if (node->left != nullptr)
+        cost += epoAt(node->left, p, prim, ranges) + epoAt(node->right, p, prim, ranges);
+    return cost;
+}
+
+/**
+ * @brief
+ * Effective Parent Overlap（Aila 等人 2013）：场景表面上落在节点 n 里、却不属于 n 的子树的那部分面积
+ * 乘上 n 的代价，对所有节点求和再除以总面积。这里按面积均匀撒 samples 个点做蒙特卡洛估计
+ */
+static double estimateEPO(const BVHAccel &bvh, const std::vector<Triangle> &triangles, int samples, uint32_t seed)
+{
+    std::map<const Object *, int> primIndex;
+    for (size_t k = 0; k < bvh.primitives.size(); ++k)
+        primIndex[bvh.primitives[k]] = k;
+    std::map<const BVHBuildNode *, std::pair<int, int>> ranges;
+    subtreeRanges(bvh.root, ranges);
+
+    std::vector<double> cdf;
+    double total = 0;
+    for (auto &tri : triangles) {
+        total += length(crossProduct(tri.e1, tri.e2)) * 0.5;
+        cdf.push_back(total);
+    }
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    double sum = 0;
+    for (int s = 0; s < samples; ++s) {
+        int t = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng) * total) - cdf.begin();
+        t = std::min<int>(t, triangles.size() - 1);
+        double a = uniform(rng), b = uniform(rng);
+        if (a + b > 1)
+            a = 1 - a, b = 1 - b;
+        const Triangle &tri = triangles[t];
+        Vector3f p = tri.v0 + tri.e1 * a + tri.e2 * b;
+        sum += epoAt(bvh.root, p, primIndex[&tri], ranges);
+    }
+    return sum / samples;
+}
+
+static const char *splitName(BVHAccel::SplitMethod method)
+{
+    return method == BVHAccel::SplitMethod::SAH ? "SAH" : "NAIVE";
+}
+
+static void writeArray(std::ostream &out, const std::vector<int> &values)
+{
+    out << "[";
+    for (size_t k = 0; k < values.size(); ++k)
+        out << (k ? ", " : "") << values[k];
+    out << "]";
+}
+
+int main(int argc, char **argv)
+{
+    // BVHQuality [--scale s] [--rays n] [--epo-samples n] [--seed n] [--out file] model.obj...
+    float scale = 1;
+    int numRays = 100000, epoSamples = 100000;
+    uint32_t seed = 1;
+    std::string outFile = "bvh_report.json";
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i + 1 < argc)
+            scale = std::stof(argv[++i]);
+        else if (arg == "--rays" && i + 1 < argc)
+            numRays = std::stoi(argv[++i]);
+        else if (arg == "--epo-samples" && i + 1 < argc)
+            epoSamples = std::stoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = std::stoul(argv[++i]);
+        else if (arg == "--out" && i + 1 < argc)
+            outFile = argv[++i];
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty()) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--scale s] [--rays n] [--epo-samples n] [--seed n] [--out file] model.obj...\n";
+        return 1;
+    }
+
+    // 和 MeshTriangle 一样按面读三角形，多个文件合成一个场景
+    std::vector<Triangle> triangles;
+    for (auto &input : inputs) {
+        objl::Loader loader;
+        if (!loader.LoadFile(input)) {
+            std::cerr << "failed to load " << input << "\n";
+            return 1;
+        }
+        for (auto &mesh : loader.LoadedMeshes)
+            for (size_t i = 0; i + 2 < mesh.Vertices.size(); i += 3) {
+                Vector3f v[3];
+                for (int j = 0; j < 3; ++j)
+                    v[j] = Vector3f(mesh.Vertices[i + j].Position.X, mesh.Vertices[i + j].Position.Y,
+                                    mesh.Vertices[i + j].Position.Z) * scale;
+                triangles.emplace_back(v[0], v[1], v[2]);
+            }
+    }
+    std::vector<Object *> ptrs;
+    Bounds3 sceneBounds;
+    for (auto &tri : triangles) {
+        ptrs.push_back(&tri);
+        sceneBounds = Union(sceneBounds, tri.getBounds());
+    }
+
+    // 固定的随机光线：起点在包围球外面一圈的球面上，指向包围盒里的随机点
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    Vector3f center = 0.5 * (sceneBounds.pMin + sceneBounds.pMax), diagonal = sceneBounds.Diagonal();
+    float radius = length(diagonal);
+    std::vector<Ray> rays;
+    for (int k = 0; k < numRays; ++k) {
+        float z = 1 - 2 * uniform(rng), r = std::sqrt(std::max(0.0f, 1 - z * z)), phi = 2 * M_PI * uniform(rng);
+        Vector3f origin = center + radius * Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+        Vector3f target = sceneBounds.pMin + Vector3f(uniform(rng) * diagonal.x, uniform(rng) * diagonal.y,
+                                                      uniform(rng) * diagonal.z);
+        rays.emplace_back(origin, normalize(target - origin));
+    }
+
+    std::ofstream out(outFile);
+    out << "{\n  \"inputs\": [";
+    for (size_t k = 0; k < inputs.size(); ++k)
+        out << (k ? ", " : "") << "\"" << inputs[k] << "\"";
+    out << "],\n  \"triangles\": " << triangles.size() << ",\n  \"rays\": " << numRays
+        << ",\n  \"epo_samples\": " << epoSamples << ",\n  \"seed\": " << seed
+        << ",\n  \"traversal_cost\": " << kTraversalCost << ",\n  \"intersect_cost\": " << kIntersectCost
+        << ",\n  \"configs\": [";
+
+    bool first = true;
+    for (auto method : {BVHAccel::SplitMethod::NAIVE, BVHAccel::SplitMethod::SAH}) {
+        for (int leafSize : {1, 2, 4, 8}) {
+            BVHAccel bvh(ptrs, leafSize, method);
+
+            TreeStats stats;
+            collect(bvh.root, 0, bvh.root->bounds.SurfaceArea(), stats);
+            stats.epo = estimateEPO(bvh, triangles, epoSamples, seed);
+
+            traversalStats = TraversalStats();
+            int hits = 0;
+            for (auto &ray : rays)
+                hits += bvh.Intersect(ray).happened;
+
+            std::cout << splitName(method) << " leaf " << leafSize << ": SAH " << stats.sahCost << ", EPO "
+                      << stats.epo << ", " << traversalStats.nodesVisited / (double)numRays << " nodes/ray\n";
+
+            out << (first ? "" : ",") << "\n    {\n      \"split\": \"" << splitName(method)
+                << "\",\n      \"max_leaf_size\": " << leafSize << ",\n      \"nodes\": " << bvh.nodeCount
+                << ",\n      \"leaves\": " << bvh.leafCount << ",\n      \"max_depth\": " << bvh.maxDepth
+                << ",\n      \"memory_bytes\": " << bvh.memoryBytes() << ",\n      \"build_ms\": "
+                << bvh.buildSeconds * 1000 << ",\n      \"sah_cost\": " << stats.sahCost
+                << ",\n      \"epo\": " << stats.epo << ",\n      \"leaf_depth_histogram\": ";
+            writeArray(out, stats.leafDepthHistogram);
+            out << ",\n      \"leaf_size_histogram\": ";
+            writeArray(out, stats.leafSizeHistogram);
+            out << ",\n      \"node_tests_per_ray\": " << traversalStats.nodesVisited / (double)numRays
+                << ",\n      \"triangle_tests_per_ray\": " << traversalStats.primitivesTested / (double)numRays
+                << ",\n      \"hit_fraction\": " << hits / (double)numRays << "\n    }";
+            first = false;
+        }
+    }
+    out << "\n  ]\n}\n";
+    std::cout << "report written to " << outFile << "\n";
+    return 0;
+}
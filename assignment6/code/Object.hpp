@@ -10,6 +10,7 @@
 #include "Bounds3.hpp"
 #include "Ray.hpp"
 #include "Intersection.hpp"
+#include "RayPacket.hpp"
 
 class Object
 {
@@ -22,6 +23,19 @@ public:
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const =0;
     virtual Bounds3 getBounds()=0;
+    // 三角形返回 true 并给出求交需要的数据，BVH 用它把叶子里的三角形打包成连续数组
+    virtual bool getTriangle(Vector3f &, Vector3f &, Vector3f &, Vector3f &) const { return false; }
+    // 对 mask 里的光线求交，比 hits 里已有交点更近时才覆盖；默认逐条调用 getIntersection
+    virtual void getIntersectionPacket(const RayPacket &packet, uint32_t mask, Intersection *hits)
+    {
+        for (size_t k = 0; k < packet.rays.size(); ++k) {
+            if (!(mask >> k & 1))
+                continue;
+            Intersection hit = getIntersection(packet.rays[k]);
+            if (hit.distance < hits[k].distance)
+                hits[k] = hit;
+        }
+    }
 };
 
 
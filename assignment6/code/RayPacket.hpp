@@ -0,0 +1,76 @@
+//
+// Coherent ray packets for primary visibility.
+//
+
+#ifndef RAYTRACING_RAYPACKET_H
+#define RAYTRACING_RAYPACKET_H
+
+#include <vector>
+#include "Ray.hpp"
+#include "Bounds3.hpp"
+
+// 一个包最多 4x4 条光线，活跃光线用一个 bit mask 表示
+constexpr int PACKET_WIDTH = 4;
+constexpr int PACKET_SIZE = PACKET_WIDTH * PACKET_WIDTH;
+// 节点上还活跃的光线少于这个数就不再成包遍历，剩下的逐条走单光线的路径
+constexpr int PACKET_MIN_ACTIVE = 3;
+
+struct RayPacket
+{
+    // 按行排列的 width x height 条光线
+    std::vector<Ray> rays;
+    int width = 0, height = 0;
+
+    // 共用原点的网格状主光线才有视锥：四个侧面过原点，法线朝里
+    bool hasFrustum = false;
+    Vector3f origin;
+    Vector3f planeNormal[4];
+
+    uint32_t fullMask() const { return rays.size() == 32 ? ~0u : (1u << rays.size()) - 1; }
+
+    /**
+     * @brief
+     * 用四个角上的光线张成视锥。网格里其余光线都在这四条光线的凸包里，
+     * 所以整个 AABB 落在某个侧面外面时整个包都可以跳过这个节点
+     */
+    void buildFrustum()
+    {
+        hasFrustum = false;
+        if (width < 2 || height < 2)
+            return;
+        origin = rays[0].origin;
+        const Vector3f &d00 = rays[0].direction, &d10 = rays[width - 1].direction;
+        const Vector3f &d01 = rays[(height - 1) * width].direction, &d11 = rays[height * width - 1].direction;
+        Vector3f center = d00 + d10 + d01 + d11;
+        Vector3f n[4] = {crossProduct(d00, d10), crossProduct(d10, d11), crossProduct(d11, d01), crossProduct(d01, d00)};
+        for (int k = 0; k < 4; ++k)
+            planeNormal[k] = dotProduct(n[k], center) < 0 ? -n[k] : n[k];
+        hasFrustum = true;
+    }
+
+    // 所有光线的方向在每个轴上同号才算相干；否则近/远子节点的顺序对不同光线不一样，包遍历没有意义
+    bool coherent() const
+    {
+        for (const Ray &r : rays) {
+            const Vector3f &d = r.direction, &d0 = rays[0].direction;
+            if ((d.x < 0) != (d0.x < 0) || (d.y < 0) != (d0.y < 0) || (d.z < 0) != (d0.z < 0))
+                return false;
+        }
+        return true;
+    }
+
+    // AABB 整个落在视锥某个侧面外面就返回 true：只需要检查沿法线方向最远的那个角
+    bool culls(const Bounds3 &b) const
+    {
+        if (!hasFrustum)
+            return false;
+        for (const Vector3f &n : planeNormal) {
+            Vector3f p(n.x > 0 ? b.pMax.x : b.pMin.x, n.y > 0 ? b.pMax.y : b.pMin.y, n.z > 0 ? b.pMax.z : b.pMin.z);
+            if (dotProduct(n, p - origin) < 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //RAYTRACING_RAYPACKET_H
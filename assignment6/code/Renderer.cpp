@@ -6,54 +6,56 @@
 #include "Scene.hpp"
 #include "Renderer.hpp"
 
-inline float deg2rad(const float &deg) { return deg * M_PI / 180.0; }
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <queue>
 
 const float EPSILON = 0.00001;
 
-// The main render function. This where we iterate over all pixels in the image,
-// generate primary rays and cast these rays into the scene. The content of the
-// framebuffer is saved to a file.
-void Renderer::Render(const Scene &scene)
+// 渲染一个块 [x0, x1) x [y0, y1)：块内每 4x4 个像素的主光线打成一个包一起遍历 BVH，
+// 交点算好之后再逐条着色（反射、阴影等次级光线仍然是单条的）
+void Renderer::renderTile(const Scene &scene, const Camera &camera, int x0, int y0, int x1, int y1,
+                          std::vector<Vector3f> &framebuffer) const
 {
-    printf(" - Render...\n\n");
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    RayPacket packet;
+    Intersection hits[PACKET_SIZE];
+    for (int py = y0; py < y1; py += PACKET_WIDTH) {
+        for (int px = x0; px < x1; px += PACKET_WIDTH) {
+            packet.width = std::min(PACKET_WIDTH, x1 - px);
+            packet.height = std::min(PACKET_WIDTH, y1 - py);
+            packet.rays.clear();
+            for (int j = py; j < py + packet.height; ++j)
+                for (int i = px; i < px + packet.width; ++i)
+                    packet.rays.emplace_back(camera.eye, camera.direction(i, j));
+            int n = packet.rays.size();
 
-    float scale = tan(deg2rad(scene.fov * 0.5));
-    float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(-1, 5, 10);
-    int m = 0;
-    for (uint32_t j = 0; j < scene.height; ++j)
-    {
-        for (uint32_t i = 0; i < scene.width; ++i)
-        {
-            // generate primary ray direction
-            float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                      imageAspectRatio * scale;
-            float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-            // TODO: Find the x and y positions of the current pixel to get the
-            // direction
-            //  vector that passes through it.
-            // Also, don't forget to multiply both of them with the variable
-            // *scale*, and x (horizontal) variable with the *imageAspectRatio*
-
-            // Don't forget to normalize this direction!
-            Vector3f dir = Vector3f(x, y, -1);
-            dir = normalize(dir);
-            // castRay(eye_pos, dir, scene, 0);
-            // printf(" - Render start...\n\n");
-            Ray ray = Ray(eye_pos, dir);
-            framebuffer[m++] = scene.castRay(ray, 0);
+            for (int k = 0; k < n; ++k)
+                hits[k] = Intersection();
+            if (usePackets) {
+                packet.buildFrustum();
+                scene.intersectPacket(packet, hits);
+            } else {
+                for (int k = 0; k < n; ++k)
+                    hits[k] = scene.intersect(packet.rays[k]);
+            }
+
+            for (int k = 0; k < n; ++k) {
+                int i = px + k % packet.width, j = py + k / packet.width;
+                framebuffer[j * scene.width + i] = scene.shade(packet.rays[k], hits[k], 0);
+            }
         }
-        UpdateProgress(j / (float)scene.height);
     }
-    UpdateProgress(1.f);
+}
 
-    // save framebuffer to file
-    FILE *fp = fopen("binary.ppm", "wb");
+static void writePPM(const std::string &filename, const Scene &scene, const std::vector<Vector3f> &framebuffer)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
     (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
     for (auto i = 0; i < scene.height * scene.width; ++i)
     {
-        static unsigned char color[3];
+        unsigned char color[3];
         color[0] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].x));
         color[1] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].y));
         color[2] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].z));
@@ -61,3 +63,134 @@ void Renderer::Render(const Scene &scene)
     }
     fclose(fp);
 }
+
+// The main render function. This where we iterate over all pixels in the image,
+// generate primary rays and cast these rays into the scene. The content of the
+// framebuffer is saved to a file.
+//
+// 图像切成 tileSize x tileSize 的块，线程按块动态领取，见 renderTile。
+void Renderer::Render(const Scene &scene)
+{
+    printf(" - Render...\n\n");
+    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+
+    Camera camera;
+    camera.fov = scene.fov;
+    camera.prepare(scene.width, scene.height);
+
+    int tilesX = (scene.width + tileSize - 1) / tileSize;
+    int tilesY = (scene.height + tileSize - 1) / tileSize;
+    int numTiles = tilesX * tilesY;
+    std::atomic<int> nextTile{0}, tilesDone{0};
+    std::mutex mtx;
+    stats = TraversalStats();
+
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> th;
+    for (int t = 0; t < num_threads; ++t) {
+        th.emplace_back([&]() {
+            traversalStats = TraversalStats();
+            for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+                renderTile(scene, camera, x0, y0, std::min(x0 + tileSize, scene.width),
+                           std::min(y0 + tileSize, scene.height), framebuffer);
+                std::lock_guard<std::mutex> lock(mtx);
+                UpdateProgress(++tilesDone / (float)numTiles);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            stats.rays += traversalStats.rays;
+            stats.nodesVisited += traversalStats.nodesVisited;
+            stats.primitivesTested += traversalStats.primitivesTested;
+        });
+    }
+    for (auto &t : th)
+        t.join();
+    UpdateProgress(1.f);
+
+    // save framebuffer to file
+    writePPM("binary.ppm", scene, framebuffer);
+}
+
+// 转台 / 相机路径：BVH 只建一次，块按 (帧, 块) 排队，每块照样按包求交（见 renderTile），
+// 做完的帧由写图线程写出
+void Renderer::RenderFrames(const Scene &scene, std::vector<Camera> cameras, const std::string &pattern)
+{
+    struct Frame
+    {
+        std::once_flag allocated;
+        std::vector<Vector3f> pixels;
+        std::atomic<int> tilesLeft{0};
+    };
+
+    printf(" - Render %zu frames...\n\n", cameras.size());
+    int numFrames = cameras.size();
+    for (auto &camera : cameras)
+        camera.prepare(scene.width, scene.height);
+
+    int tilesX = (scene.width + tileSize - 1) / tileSize;
+    int tilesY = (scene.height + tileSize - 1) / tileSize;
+    int tilesPerFrame = tilesX * tilesY;
+    int numJobs = numFrames * tilesPerFrame;
+    std::vector<Frame> frames(numFrames);
+    for (auto &frame : frames)
+        frame.tilesLeft = tilesPerFrame;
+    std::atomic<int> nextJob{0}, tilesDone{0};
+    std::mutex mtx;
+    stats = TraversalStats();
+
+    // 写图线程：等完成的帧号，写完释放帧缓冲
+    std::queue<int> readyFrames;
+    bool allRendered = false;
+    std::condition_variable frameReady;
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            frameReady.wait(lock, [&] { return !readyFrames.empty() || allRendered; });
+            if (readyFrames.empty())
+                return;
+            int f = readyFrames.front();
+            readyFrames.pop();
+            lock.unlock();
+            char filename[256];
+            snprintf(filename, sizeof(filename), pattern.c_str(), f);
+            writePPM(filename, scene, frames[f].pixels);
+            std::vector<Vector3f>().swap(frames[f].pixels);
+            lock.lock();
+        }
+    });
+
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> th;
+    for (int t = 0; t < num_threads; ++t) {
+        th.emplace_back([&]() {
+            traversalStats = TraversalStats();
+            for (int job = nextJob++; job < numJobs; job = nextJob++) {
+                int f = job / tilesPerFrame, tile = job % tilesPerFrame;
+                Frame &frame = frames[f];
+                std::call_once(frame.allocated, [&] { frame.pixels.resize(scene.width * scene.height); });
+                int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+                renderTile(scene, cameras[f], x0, y0, std::min(x0 + tileSize, scene.width),
+                           std::min(y0 + tileSize, scene.height), frame.pixels);
+                std::lock_guard<std::mutex> lock(mtx);
+                if (--frame.tilesLeft == 0) {
+                    readyFrames.push(f);
+                    frameReady.notify_one();
+                }
+                UpdateProgress(++tilesDone / (float)numJobs);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            stats.rays += traversalStats.rays;
+            stats.nodesVisited += traversalStats.nodesVisited;
+            stats.primitivesTested += traversalStats.primitivesTested;
+        });
+    }
+    for (auto &t : th)
+        t.join();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        allRendered = true;
+        frameReady.notify_one();
+    }
+    writer.join();
+    UpdateProgress(1.f);
+}
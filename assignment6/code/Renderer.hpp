@@ -2,6 +2,8 @@
 // Created by goksu on 2/25/20.
 //
 #include "Scene.hpp"
+#include "Camera.hpp"
+#include <string>
 
 #pragma once
 struct hit_payload
@@ -16,6 +18,18 @@ class Renderer
 {
 public:
     void Render(const Scene& scene);
+    // 依次渲染 cameras 里的每个相机，第 f 帧写到 printf(pattern, f)
+    void RenderFrames(const Scene& scene, std::vector<Camera> cameras,
+                      const std::string& pattern = "frame_%04d.ppm");
+
+    // 主光线按 4x4 成包求交；关掉时同样按块并行，但每条主光线单独遍历 BVH
+    bool usePackets = true;
+    // 线程每次领取的块的边长（像素）
+    int tileSize = 16;
+    // 上一次 Render 所有线程的遍历统计之和
+    TraversalStats stats;
 
 private:
+    void renderTile(const Scene& scene, const Camera& camera, int x0, int y0, int x1, int y1,
+                    std::vector<Vector3f>& framebuffer) const;
 };
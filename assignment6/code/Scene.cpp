@@ -12,9 +12,16 @@ void Scene::buildBVH() {
 
 Intersection Scene::intersect(const Ray &ray) const
 {
+    traversalStats.rays++;
     return this->bvh->Intersect(ray);
 }
 
+void Scene::intersectPacket(const RayPacket &packet, Intersection *hits) const
+{
+    traversalStats.rays += packet.rays.size();
+    this->bvh->IntersectPacket(packet, packet.fullMask(), hits);
+}
+
 bool Scene::trace(
         const Ray &ray,
         const std::vector<Object*> &objects,
@@ -55,7 +62,11 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
     if (depth > this->maxDepth) {
         return Vector3f(0.0,0.0,0.0);
     }
-    Intersection intersection = Scene::intersect(ray);
+    return shade(ray, Scene::intersect(ray), depth);
+}
+
+Vector3f Scene::shade(const Ray &ray, const Intersection &intersection, int depth) const
+{
     Material *m = intersection.m;
     Object *hitObject = intersection.obj;
     Vector3f hitColor = this->backgroundColor;
@@ -35,6 +35,9 @@ public:
     BVHAccel *bvh;
     void buildBVH();
     Vector3f castRay(const Ray &ray, int depth) const;
+    // 已经求好交点的光线着色，castRay = shade(ray, intersect(ray))，主光线成包求交之后逐条调用它
+    Vector3f shade(const Ray &ray, const Intersection &intersection, int depth) const;
+    void intersectPacket(const RayPacket &packet, Intersection *hits) const;
     bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
                                                    const Vector3f &shadowPointOrig,
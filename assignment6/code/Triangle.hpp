@@ -9,7 +9,7 @@
 #include <cassert>
 #include <array>
 
-bool rayTriangleIntersect(const Vector3f &v0, const Vector3f &v1,
+inline bool rayTriangleIntersect(const Vector3f &v0, const Vector3f &v1,
                           const Vector3f &v2, const Vector3f &orig,
                           const Vector3f &dir, float &tnear, float &u, float &v)
 {
@@ -70,6 +70,11 @@ public:
     }
     Vector3f evalDiffuseColor(const Vector2f &) const override;
     Bounds3 getBounds() override;
+    bool getTriangle(Vector3f &_v0, Vector3f &_e1, Vector3f &_e2, Vector3f &_normal) const override
+    {
+        _v0 = v0, _e1 = e1, _e2 = e2, _normal = normal;
+        return true;
+    }
 };
 
 class MeshTriangle : public Object
@@ -125,7 +130,17 @@ public:
         for (auto &tri : triangles)
             ptrs.push_back(&tri);
 
-        bvh = new BVHAccel(ptrs);
+        bvh = new BVHAccel(ptrs, 4);
+    }
+
+    // 用新的叶子大小重建网格内部的 BVH（leaf-size sweep 用）
+    void rebuildBVH(int maxPrimsInNode)
+    {
+        std::vector<Object *> ptrs;
+        for (auto &tri : triangles)
+            ptrs.push_back(&tri);
+        delete bvh;
+        bvh = new BVHAccel(ptrs, maxPrimsInNode);
     }
 
     bool intersect(const Ray &ray) { return true; }
@@ -191,6 +206,12 @@ public:
         return intersec;
     }
 
+    void getIntersectionPacket(const RayPacket &packet, uint32_t mask, Intersection *hits) override
+    {
+        if (bvh)
+            bvh->IntersectPacket(packet, mask, hits);
+    }
+
     Bounds3 bounding_box;
     std::unique_ptr<Vector3f[]> vertices;
     uint32_t numTriangles;
@@ -235,6 +256,9 @@ inline Intersection Triangle::getIntersection(Ray ray)
     if (v < 0 || u + v > 1)
         return inter;
     t_tmp = dotProduct(e2, qvec) * det_inv;
+    // 原点后面的交点不算（多图元叶子的包围盒更大，不排除的话次级光线会打到身后的三角形）
+    if (t_tmp < 0)
+        return inter;
 
     // TODO find ray triangle intersection
     inter.happened = true;
@@ -21,10 +21,74 @@ int main(int argc, char** argv)
     scene.buildBVH();
 
     Renderer r;
+    // --no-packets: 主光线逐条求交（用来对比），--tile N: 线程领取的块大小
+    // --leaf-sweep: 兔子的 BVH 分别用 1, 2, 4, 8 个三角形的叶子重建并渲染，输出对比表
+    // --turntable N: 绕兔子转一圈渲染 N 帧，--camera-path file: 每行 "ex ey ez tx ty tz [fov]"，都输出 frame_%04d.ppm
+    bool leafSweep = false;
+    int turntableFrames = 0;
+    std::string cameraPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-packets")
+            r.usePackets = false;
+        else if (arg == "--tile" && i + 1 < argc)
+            r.tileSize = std::max(PACKET_WIDTH, std::stoi(argv[++i]));
+        else if (arg == "--leaf-sweep")
+            leafSweep = true;
+        else if (arg == "--turntable" && i + 1 < argc)
+            turntableFrames = std::stoi(argv[++i]);
+        else if (arg == "--camera-path" && i + 1 < argc)
+            cameraPath = argv[++i];
+    }
+
+    if (leafSweep) {
+        std::vector<std::string> rows;
+        for (int leafSize : {1, 2, 4, 8}) {
+            bunny.rebuildBVH(leafSize);
+            auto begin = std::chrono::steady_clock::now();
+            r.Render(scene);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            const BVHAccel &bvh = *bunny.bvh;
+            char row[256];
+            snprintf(row, sizeof(row), "%9d %8d %8d %6d %10.1f %9.2f %8.2f %10.2f %10.2f",
+                     leafSize, bvh.nodeCount, bvh.leafCount, bvh.maxDepth, bvh.memoryBytes() / 1024.0,
+                     bvh.buildSeconds * 1000, seconds,
+                     r.stats.nodesVisited / (double)r.stats.rays, r.stats.primitivesTested / (double)r.stats.rays);
+            rows.push_back(row);
+        }
+        printf("\nleaf size    nodes   leaves  depth  memory KB  build ms render s  nodes/ray   tris/ray\n");
+        for (auto &row : rows)
+            printf("%s\n", row.c_str());
+        return 0;
+    }
+
+    if (turntableFrames > 0 || !cameraPath.empty()) {
+        std::vector<Camera> cameras;
+        if (!cameraPath.empty()) {
+            cameras = LoadCameraPath(cameraPath, scene.fov);
+        } else {
+            // 从默认的相机位置出发，看向兔子包围盒的中心
+            Camera start;
+            start.target = scene.bvh->root->bounds.Centroid();
+            start.fov = scene.fov;
+            cameras = Turntable(start, turntableFrames);
+        }
+        if (cameras.empty()) {
+            std::cerr << "no cameras to render\n";
+            return 1;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        r.RenderFrames(scene, cameras);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        printf("\n%zu frames in %.2f s (%.3f s/frame)\n", cameras.size(), seconds, seconds / cameras.size());
+        return 0;
+    }
 
     auto start = std::chrono::system_clock::now();
     r.Render(scene);
     auto stop = std::chrono::system_clock::now();
+    printf("%.2f BVH nodes, %.2f primitives tested per ray\n",
+           r.stats.nodesVisited / (double)r.stats.rays, r.stats.primitivesTested / (double)r.stats.rays);
 
     std::cout << "Render complete: \n";
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
@@ -3,8 +3,9 @@
 #include "BVH.hpp"
 
 BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
-                   SplitMethod splitMethod)
+                   SplitMethod splitMethod, BuildMode buildMode, int eagerDepth)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+      buildMode(buildMode), eagerDepth(std::max(0, eagerDepth)),
       primitives(std::move(p))
 {
     time_t start, stop;
@@ -21,34 +22,76 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
     int secs = (int)diff - (hrs * 3600) - (mins * 60);
 
     printf(
-        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
-        hrs, mins, secs);
+        "\rBVH Generation complete%s: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
+        buildMode == BuildMode::LAZY ? " (lazy)" : "", hrs, mins, secs);
 }
 
-BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
+BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects, int depth) const
 {
     BVHBuildNode* node = new BVHBuildNode();
 
+    if (buildMode == BuildMode::LAZY && depth >= eagerDepth && objects.size() > 1) {
+        // 超过 eagerDepth 的子树先不划分，只记下包围盒和面积（getSample 需要），
+        // 等第一次有光线进入时再由 expand 展开
+        for (auto object : objects) {
+            node->bounds = Union(node->bounds, object->getBounds());
+            node->area += object->getArea();
+        }
+        node->pending = std::move(objects);
+        node->state.store(BVHBuildNode::UNBUILT, std::memory_order_release);
+        return node;
+    }
+
+    buildNode(node, std::move(objects), depth);
+    if (node->left == nullptr) {
+        node->bounds = node->object->getBounds();
+        node->area = node->object->getArea();
+    } else {
+        node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->area = node->left->area + node->right->area;
+    }
+    return node;
+}
+
+/**
+ * @brief 
+ * 第一次访问到未展开的节点时划分一层，子节点同样是未展开的。
+ * 抢到 CAS 的线程负责划分，其他线程等它把 state 置为 BUILT 之后再继续遍历。
+ * 节点的 bounds 和 area 在 recursiveBuild 里就定了，这里不改：别的线程不等 BUILT 就会读它们
+ * @param node 
+ */
+void BVHAccel::expand(BVHBuildNode* node) const
+{
+    int expected = BVHBuildNode::UNBUILT;
+    if (node->state.compare_exchange_strong(expected, BVHBuildNode::BUILDING,
+                                            std::memory_order_acquire)) {
+        std::vector<Object*> objects;
+        objects.swap(node->pending);
+        buildNode(node, std::move(objects), eagerDepth);
+        node->state.store(BVHBuildNode::BUILT, std::memory_order_release);
+        return;
+    }
+    while (node->state.load(std::memory_order_acquire) != BVHBuildNode::BUILT)
+        std::this_thread::yield();
+}
+
+void BVHAccel::buildNode(BVHBuildNode* node, std::vector<Object*> objects, int depth) const
+{
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
     for (int i = 0; i < objects.size(); ++i)
         bounds = Union(bounds, objects[i]->getBounds());
     if (objects.size() == 1) {
         // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
         node->object = objects[0];
         node->left = nullptr;
         node->right = nullptr;
-        node->area = objects[0]->getArea();
-        return node;
+        return;
     }
     else if (objects.size() == 2) {
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
-
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
-        return node;
+        node->left = recursiveBuild(std::vector{objects[0]}, depth + 1);
+        node->right = recursiveBuild(std::vector{objects[1]}, depth + 1);
+        return;
     }
     else {
         Bounds3 centroidBounds;
@@ -86,14 +129,9 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 
         assert(objects.size() == (leftshapes.size() + rightshapes.size()));
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
-
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
+        node->left = recursiveBuild(leftshapes, depth + 1);
+        node->right = recursiveBuild(rightshapes, depth + 1);
     }
-
-    return node;
 }
 
 Intersection BVHAccel::Intersect(const Ray& ray) const
@@ -119,6 +157,8 @@ Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
     {
         return {};
     }
+    if (node->state.load(std::memory_order_acquire) != BVHBuildNode::BUILT)
+        expand(node);
 
     // 如果碰撞盒不再继续细分，测试碰撞盒内的所有物体是否与光线相交，返回最早相交的
     if (node->left == nullptr && node->right == nullptr)
@@ -134,6 +174,8 @@ Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
 
 
 void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf){
+    if (node->state.load(std::memory_order_acquire) != BVHBuildNode::BUILT)
+        expand(node);
     if(node->left == nullptr || node->right == nullptr){
         node->object->Sample(pos, pdf);
         pdf *= node->area;
@@ -9,6 +9,7 @@
 #include <vector>
 #include <memory>
 #include <ctime>
+#include <thread>
 #include "Object.hpp"
 #include "Ray.hpp"
 #include "Bounds3.hpp"
@@ -26,9 +27,12 @@ class BVHAccel {
 public:
     // BVHAccel Public Types
     enum class SplitMethod { NAIVE, SAH };
+    // EAGER: 构造时建完整棵树；LAZY: 只建前 eagerDepth 层，其余子树等光线第一次进入时再划分
+    enum class BuildMode { EAGER, LAZY };
 
     // BVHAccel Public Methods
-    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE,
+             BuildMode buildMode = BuildMode::EAGER, int eagerDepth = 4);
     Bounds3 WorldBound() const;
     ~BVHAccel();
 
@@ -38,11 +42,16 @@ public:
     BVHBuildNode* root;
 
     // BVHAccel Private Methods
-    BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    BVHBuildNode* recursiveBuild(std::vector<Object*>objects, int depth = 0) const;
+    // 只做划分（设置 object / left / right），节点的 bounds 和 area 由调用者负责
+    void buildNode(BVHBuildNode* node, std::vector<Object*> objects, int depth) const;
+    void expand(BVHBuildNode* node) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    const BuildMode buildMode;
+    const int eagerDepth;
     std::vector<Object*> primitives;
 
     void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
@@ -54,7 +63,12 @@ struct BVHBuildNode {
     BVHBuildNode *left;
     BVHBuildNode *right;
     Object* object;
-    float area;
+    float area = 0;
+
+    // 延迟构建的节点：pending 保存还没划分的图元，state 保证只有一个线程负责展开
+    enum : int { UNBUILT = 0, BUILDING = 1, BUILT = 2 };
+    std::vector<Object*> pending;
+    std::atomic<int> state{BUILT};
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0;
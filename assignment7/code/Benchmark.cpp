@@ -0,0 +1,182 @@
+//
+// Time-to-quality benchmark: error against a stored reference vs wall-clock.
+//
+
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include "Benchmark.hpp"
+
+// Render 写 PPM 时用的 gamma
+static const float kDisplayGamma = 0.6f;
+
+void writePFM(const std::string &filename, int width, int height, const std::vector<Vector3f> &pixels)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
+    // 负的 scale 表示 little-endian，PFM 的行是从下往上存的
+    (void)fprintf(fp, "PF\n%d %d\n-1.0\n", width, height);
+    for (int j = height - 1; j >= 0; --j)
+        for (int i = 0; i < width; ++i) {
+            const Vector3f &c = pixels[j * width + i];
+            float rgb[3] = {c.x, c.y, c.z};
+            fwrite(rgb, sizeof(float), 3, fp);
+        }
+    fclose(fp);
+}
+
+bool loadImage(const std::string &filename, int &width, int &height, std::vector<Vector3f> &pixels, bool &linear)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        return false;
+    std::string magic;
+    float maxval;
+    in >> magic >> width >> height >> maxval;
+    in.get();
+    if (!in || width <= 0 || height <= 0)
+        return false;
+    pixels.assign(width * height, Vector3f(0.0f));
+
+    if (magic == "PF") {
+        linear = true;
+        std::vector<float> row(width * 3);
+        for (int j = height - 1; j >= 0; --j) {
+            if (!in.read(reinterpret_cast<char *>(row.data()), row.size() * sizeof(float)))
+                return false;
+            for (int i = 0; i < width; ++i)
+                pixels[j * width + i] = Vector3f(row[3 * i], row[3 * i + 1], row[3 * i + 2]);
+        }
+        return true;
+    }
+    if (magic == "P6" && maxval == 255) {
+        // PPM 已经被截断到 [0,1] 并做过 gamma，这里只能反解回 [0,1] 的线性值
+        linear = false;
+        std::vector<unsigned char> data(width * height * 3);
+        if (!in.read(reinterpret_cast<char *>(data.data()), data.size()))
+            return false;
+        for (int p = 0; p < width * height; ++p)
+            pixels[p] = Vector3f(std::pow(data[3 * p] / 255.f, 1 / kDisplayGamma),
+                                 std::pow(data[3 * p + 1] / 255.f, 1 / kDisplayGamma),
+                                 std::pow(data[3 * p + 2] / 255.f, 1 / kDisplayGamma));
+        return true;
+    }
+    return false;
+}
+
+void RenderReference(Renderer &r, const Scene &scene, int spp, const std::string &filename)
+{
+    std::vector<Vector3f> image(scene.width * scene.height);
+    ProgressiveOptions options;
+    options.spp = spp;
+    options.startStride = 1;
+    options.interval = 1e30f;
+    // 只要 PFM，不写预览图
+    options.filename.clear();
+    options.onPass = [&](int, double, const std::vector<Vector3f> &sum, const std::vector<int> &count) {
+        for (size_t p = 0; p < image.size(); ++p)
+            image[p] = count[p] > 0 ? sum[p] / count[p] : Vector3f(0.0f);
+    };
+    r.RenderProgressive(scene, options);
+    writePFM(filename, scene.width, scene.height, image);
+    std::cout << "Reference (" << spp << " spp) written to " << filename << "\n";
+}
+
+double RunConvergenceBenchmark(Renderer &r, const Scene &scene, const BenchmarkOptions &options)
+{
+    int refWidth, refHeight;
+    bool linear;
+    std::vector<Vector3f> reference;
+    if (!loadImage(options.reference, refWidth, refHeight, reference, linear)) {
+        std::cerr << "Failed to load reference image " << options.reference << "\n";
+        return -1;
+    }
+    if (refWidth != scene.width || refHeight != scene.height) {
+        std::cerr << "Reference is " << refWidth << "x" << refHeight << ", scene is "
+                  << scene.width << "x" << scene.height << "\n";
+        return -1;
+    }
+
+    std::vector<ConvergencePoint> curve;
+    double nextCheckpoint = options.interval;
+    // 统计误差本身的耗时要从时间轴里扣掉
+    double overhead = 0;
+
+    ProgressiveOptions progressive;
+    progressive.spp = 1 << 30;
+    progressive.startStride = 1;
+    progressive.maxSamplesPerPass = 1;
+    progressive.interval = 1e30f;
+    progressive.filename.clear();
+    // 时间轴扣掉了统计误差的耗时，停止时间也要一起推后，否则最后一个记录点会被截掉
+    progressive.timeLimit = options.duration;
+    progressive.onPass = [&](int, double seconds, const std::vector<Vector3f> &sum, const std::vector<int> &count) {
+        seconds -= overhead;
+        if (seconds < nextCheckpoint && seconds < options.duration)
+            return;
+        auto begin = std::chrono::steady_clock::now();
+        double se = 0, rel = 0, samples = 0;
+        for (size_t p = 0; p < reference.size(); ++p) {
+            Vector3f c = count[p] > 0 ? sum[p] / count[p] : Vector3f(0.0f);
+            if (!linear)
+                c = Vector3f(clamp(0, 1, c.x), clamp(0, 1, c.y), clamp(0, 1, c.z));
+            samples += count[p];
+            const Vector3f &ref = reference[p];
+            double d[3] = {c.x - ref.x, c.y - ref.y, c.z - ref.z};
+            double v[3] = {ref.x, ref.y, ref.z};
+            for (int k = 0; k < 3; ++k) {
+                se += d[k] * d[k];
+                rel += d[k] * d[k] / (v[k] * v[k] + 1e-2);
+            }
+        }
+        double n = 3.0 * reference.size();
+        curve.push_back({seconds, samples / reference.size(), std::sqrt(se / n), rel / n});
+        while (nextCheckpoint <= seconds)
+            nextCheckpoint += options.interval;
+        std::cout << "t=" << seconds << "s spp=" << curve.back().spp << " rmse=" << curve.back().rmse
+                  << " relMSE=" << curve.back().relMSE << "\n";
+        overhead += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        progressive.timeLimit = options.duration + overhead;
+    };
+    r.RenderProgressive(scene, progressive);
+
+    // 在第一次低于目标误差的两个记录点之间线性插值
+    double timeToTarget = -1;
+    for (size_t k = 0; k < curve.size(); ++k) {
+        if (curve[k].relMSE > options.targetError)
+            continue;
+        if (k == 0) {
+            timeToTarget = curve[k].seconds;
+        } else {
+            const ConvergencePoint &a = curve[k - 1], &b = curve[k];
+            double t = (a.relMSE - options.targetError) / (a.relMSE - b.relMSE);
+            timeToTarget = a.seconds + t * (b.seconds - a.seconds);
+        }
+        break;
+    }
+
+    std::ofstream csv(options.csvFilename);
+    csv << "seconds,spp,rmse,relmse\n";
+    for (auto &pt : curve)
+        csv << pt.seconds << "," << pt.spp << "," << pt.rmse << "," << pt.relMSE << "\n";
+
+    std::ofstream json(options.jsonFilename);
+    json << "{\n  \"reference\": \"" << options.reference << "\",\n"
+         << "  \"interval\": " << options.interval << ",\n"
+         << "  \"target_relmse\": " << options.targetError << ",\n"
+         << "  \"time_to_target\": ";
+    if (timeToTarget < 0)
+        json << "null";
+    else
+        json << timeToTarget;
+    json << ",\n  \"curve\": [";
+    for (size_t k = 0; k < curve.size(); ++k)
+        json << (k ? "," : "") << "\n    {\"seconds\": " << curve[k].seconds << ", \"spp\": " << curve[k].spp
+             << ", \"rmse\": " << curve[k].rmse << ", \"relmse\": " << curve[k].relMSE << "}";
+    json << "\n  ]\n}\n";
+
+    if (timeToTarget < 0)
+        std::cout << "relMSE " << options.targetError << " not reached within " << options.duration << " s\n";
+    else
+        std::cout << "Time to relMSE " << options.targetError << ": " << timeToTarget << " s\n";
+    return timeToTarget;
+}
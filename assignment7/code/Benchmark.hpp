@@ -0,0 +1,40 @@
+//
+// Time-to-quality benchmark: error against a stored reference vs wall-clock.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Renderer.hpp"
+
+struct BenchmarkOptions
+{
+    // 参考图，.pfm（线性浮点）或者 Render 写出的 .ppm（按 0.6 的 gamma 反解）
+    std::string reference;
+    // 每隔多少秒记录一次误差
+    double interval = 1.0;
+    // 最多跑多少秒
+    double duration = 60.0;
+    // "time to reach error X" 里的 X，按 relMSE 计算
+    double targetError = 0.01;
+    std::string csvFilename = "convergence.csv";
+    std::string jsonFilename = "convergence.json";
+};
+
+struct ConvergencePoint
+{
+    double seconds;
+    double spp;
+    double rmse;
+    double relMSE;
+};
+
+bool loadImage(const std::string &filename, int &width, int &height, std::vector<Vector3f> &pixels, bool &linear);
+void writePFM(const std::string &filename, int width, int height, const std::vector<Vector3f> &pixels);
+
+// 渲染 spp 很高的参考图并写成 PFM
+void RenderReference(Renderer &r, const Scene &scene, int spp, const std::string &filename);
+
+// 渐进式渲染并按固定间隔记录 RMSE / relMSE，写出收敛曲线，返回达到 targetError 的时间（没达到返回 -1）
+double RunConvergenceBenchmark(Renderer &r, const Scene &scene, const BenchmarkOptions &options);
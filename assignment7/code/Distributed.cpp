@@ -0,0 +1,177 @@
+//
+// Coordinator / worker rendering across processes.
+//
+
+#include "Distributed.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <csignal>
+#include <cstring>
+#include <string>
+
+// 管道上的消息：
+//   任务  int32 rowBegin, int32 rowEnd（rowBegin < 0 表示退出）
+//   结果  int32 rowBegin, int32 rowEnd, 然后每个像素 float sum[3] + int32 count
+struct PixelResult
+{
+    float sum[3];
+    int32_t count;
+};
+
+static bool readAll(int fd, void *buffer, size_t size)
+{
+    char *p = static_cast<char *>(buffer);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *buffer, size_t size)
+{
+    const char *p = static_cast<const char *>(buffer);
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+void RunWorker(Renderer &r, const Scene &scene, int readFd, int writeFd)
+{
+    int32_t job[2];
+    std::vector<Vector3f> sum;
+    std::vector<PixelResult> result;
+    // 引导和 irradiance cache 在领第一个任务之前各自学一次，之后所有任务共用
+    r.Prepare(scene);
+    while (readAll(readFd, job, sizeof(job)) && job[0] >= 0) {
+        r.RenderRows(scene, job[0], job[1], sum);
+        result.resize(sum.size());
+        for (size_t p = 0; p < sum.size(); ++p)
+            result[p] = {{sum[p].x, sum[p].y, sum[p].z}, r.spp};
+        if (!writeAll(writeFd, job, sizeof(job)) ||
+            !writeAll(writeFd, result.data(), result.size() * sizeof(PixelResult)))
+            break;
+    }
+    close(readFd);
+    close(writeFd);
+}
+
+struct WorkerProcess
+{
+    pid_t pid;
+    int jobFd, resultFd;
+};
+
+// 用 /proc/self/exe 重新启动自己，原来的参数之后追加 --worker <读端> <写端>。
+// 管道都带 O_CLOEXEC，后启动的 worker 不会继承前面 worker 的管道，只有自己的两端在 exec 前去掉这个标志
+static WorkerProcess spawnWorker(int argc, char **argv)
+{
+    int jobPipe[2], resultPipe[2];
+    if (pipe2(jobPipe, O_CLOEXEC) != 0 || pipe2(resultPipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(jobPipe[1]);
+        close(resultPipe[0]);
+        fcntl(jobPipe[0], F_SETFD, 0);
+        fcntl(resultPipe[1], F_SETFD, 0);
+        std::vector<std::string> args(argv, argv + argc);
+        args.push_back("--worker");
+        args.push_back(std::to_string(jobPipe[0]));
+        args.push_back(std::to_string(resultPipe[1]));
+        std::vector<char *> cargs;
+        for (auto &a : args)
+            cargs.push_back(&a[0]);
+        cargs.push_back(nullptr);
+        execv("/proc/self/exe", cargs.data());
+        perror("execv");
+        _exit(1);
+    }
+    close(jobPipe[0]);
+    close(resultPipe[1]);
+    return {pid, jobPipe[1], resultPipe[0]};
+}
+
+void RenderDistributed(Renderer &r, const Scene &scene, int workers, int rowsPerJob, int argc, char **argv)
+{
+    // worker 提前退出时写管道不要把 coordinator 杀掉
+    signal(SIGPIPE, SIG_IGN);
+    std::cout << "SPP: " << r.spp << ", " << workers << " workers, " << rowsPerJob << " rows per job\n";
+
+    std::vector<WorkerProcess> procs;
+    for (int w = 0; w < workers; ++w)
+        procs.push_back(spawnWorker(argc, argv));
+
+    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    int nextRow = 0, rowsDone = 0;
+    // 没有剩余任务时发退出消息，返回这个 worker 是否还在干活
+    auto assign = [&](WorkerProcess &proc) {
+        int32_t job[2] = {-1, -1};
+        if (nextRow < scene.height) {
+            job[0] = nextRow;
+            job[1] = std::min(scene.height, nextRow + rowsPerJob);
+            nextRow = job[1];
+        }
+        writeAll(proc.jobFd, job, sizeof(job));
+        return job[0] >= 0;
+    };
+
+    std::vector<pollfd> fds;
+    for (auto &proc : procs)
+        fds.push_back({assign(proc) ? proc.resultFd : -1, POLLIN, 0});
+
+    std::vector<PixelResult> result;
+    while (rowsDone < scene.height) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            perror("poll");
+            break;
+        }
+        for (size_t w = 0; w < procs.size(); ++w) {
+            if (fds[w].fd < 0 || !(fds[w].revents & (POLLIN | POLLHUP)))
+                continue;
+            int32_t job[2];
+            if (!readAll(fds[w].fd, job, sizeof(job))) {
+                std::cerr << "worker " << procs[w].pid << " exited early\n";
+                exit(1);
+            }
+            result.resize((job[1] - job[0]) * scene.width);
+            if (!readAll(fds[w].fd, result.data(), result.size() * sizeof(PixelResult))) {
+                std::cerr << "worker " << procs[w].pid << " exited early\n";
+                exit(1);
+            }
+            for (size_t p = 0; p < result.size(); ++p) {
+                const PixelResult &px = result[p];
+                framebuffer[job[0] * scene.width + p] = Vector3f(px.sum[0], px.sum[1], px.sum[2]) / px.count;
+            }
+            rowsDone += job[1] - job[0];
+            UpdateProgress(rowsDone / (float)scene.height);
+            if (!assign(procs[w]))
+                fds[w].fd = -1;
+        }
+    }
+
+    for (auto &proc : procs) {
+        close(proc.jobFd);
+        close(proc.resultFd);
+        waitpid(proc.pid, nullptr, 0);
+    }
+    UpdateProgress(1.f);
+    writePPM("binary.ppm", scene, framebuffer);
+}
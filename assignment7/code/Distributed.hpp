@@ -0,0 +1,22 @@
+//
+// Coordinator / worker rendering across processes.
+//
+
+#pragma once
+
+#include "Scene.hpp"
+#include "Renderer.hpp"
+
+/**
+ * @brief
+ * coordinator 启动 workers 个 worker 进程（同一个可执行文件加上 --worker），通过管道按
+ * rowsPerJob 行一批动态派发任务。worker 返回每个像素未归一化的 radiance 和与采样数，
+ * coordinator 按行拼起来再除以采样数。每个采样的种子只由 (像素, 采样序号) 决定，
+ * 所以结果和单进程的 Render 逐位相同。
+ * --guide / --irradiance-cache 时每个 worker 在领任务前自己训练 / 播种一次（RunWorker 里调 Renderer::Prepare），
+ * 各进程学到的分布不同，这时结果和单进程的不再逐位相同。
+ */
+void RenderDistributed(Renderer &r, const Scene &scene, int workers, int rowsPerJob, int argc, char **argv);
+
+// --worker 模式：从 readFd 读 [rowBegin, rowEnd)，渲染后把结果写到 writeFd，直到收到 rowBegin < 0
+void RunWorker(Renderer &r, const Scene &scene, int readFd, int writeFd);
@@ -0,0 +1,228 @@
+//
+// Path guiding: an adaptive spatial-directional radiance cache (SD-tree).
+//
+
+#include "Guiding.hpp"
+#include "global.hpp"
+
+static void atomicAdd(std::atomic<float> &a, float v)
+{
+    float cur = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed))
+        ;
+}
+
+// 方向 <-> [0,1]^2：x = (cosθ + 1) / 2, y = φ / 2π，这个映射是等面积的，所以 pdf 只差一个 4π
+static Vector2f dirToCanonical(const Vector3f &d)
+{
+    float cosTheta = clamp(-1, 1, d.z);
+    float phi = std::atan2(d.y, d.x);
+    if (phi < 0)
+        phi += 2 * M_PI;
+    return Vector2f(std::min((cosTheta + 1) * 0.5f, 0.99999994f),
+                    std::min(phi / (2 * M_PI), 0.99999994f));
+}
+
+static Vector3f canonicalToDir(float x, float y)
+{
+    float cosTheta = 2 * x - 1;
+    float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+    float phi = 2 * M_PI * y;
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+DTree::Node::Node()
+{
+    for (int q = 0; q < 4; ++q)
+        sum[q] = 0;
+}
+
+DTree::Node::Node(const Node &other)
+{
+    *this = other;
+}
+
+DTree::Node &DTree::Node::operator=(const Node &other)
+{
+    for (int q = 0; q < 4; ++q) {
+        sum[q] = other.sum[q].load(std::memory_order_relaxed);
+        child[q] = other.child[q];
+    }
+    return *this;
+}
+
+float DTree::Node::total() const
+{
+    return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+DTree::DTree() : nodes(1) {}
+
+DTree::DTree(const DTree &other) : nodes(other.nodes)
+{
+    samples = other.samples.load();
+}
+
+DTree &DTree::operator=(const DTree &other)
+{
+    nodes = other.nodes;
+    samples = other.samples.load();
+    return *this;
+}
+
+float DTree::total() const
+{
+    return nodes[0].total();
+}
+
+// 每一层都往对应象限累加，这样任意节点的象限和就是它子树里的能量
+void DTree::record(const Vector3f &dir, float value)
+{
+    Vector2f p = dirToCanonical(dir);
+    int index = 0;
+    while (true) {
+        int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+        atomicAdd(nodes[index].sum[q], value);
+        if (nodes[index].child[q] == 0)
+            break;
+        index = nodes[index].child[q];
+        p = Vector2f(p.x * 2 - qx, p.y * 2 - qy);
+    }
+}
+
+float DTree::pdf(const Vector3f &dir) const
+{
+    Vector2f p = dirToCanonical(dir);
+    float result = 1;
+    int index = 0;
+    while (true) {
+        const Node &node = nodes[index];
+        float nodeTotal = node.total();
+        int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+        if (nodeTotal <= 0)
+            return 0;
+        result *= 4 * node.sum[q] / nodeTotal;
+        if (node.child[q] == 0)
+            break;
+        index = node.child[q];
+        p = Vector2f(p.x * 2 - qx, p.y * 2 - qy);
+    }
+    return result / (4 * M_PI);
+}
+
+Vector3f DTree::sample() const
+{
+    float x = 0, y = 0, size = 1;
+    int index = 0;
+    while (true) {
+        const Node &node = nodes[index];
+        float u = get_random_float() * node.total();
+        int q = 0;
+        while (q < 3 && u >= node.sum[q]) {
+            u -= node.sum[q];
+            ++q;
+        }
+        size *= 0.5f;
+        x += (q & 1) * size;
+        y += (q >> 1) * size;
+        if (node.child[q] == 0)
+            break;
+        index = node.child[q];
+    }
+    return canonicalToDir(x + get_random_float() * size, y + get_random_float() * size);
+}
+
+// oldIndex < 0 表示旧树在这里已经是叶子，能量按面积均分给四个象限
+int DTree::build(DTree &out, int oldIndex, const float energy[4], float threshold, int depth, int maxDepth) const
+{
+    int index = out.nodes.size();
+    out.nodes.emplace_back();
+    for (int q = 0; q < 4; ++q) {
+        if (energy[q] <= threshold || depth >= maxDepth)
+            continue;
+        int oldChild = oldIndex >= 0 ? nodes[oldIndex].child[q] : 0;
+        float childEnergy[4];
+        for (int c = 0; c < 4; ++c)
+            childEnergy[c] = oldChild ? nodes[oldChild].sum[c].load() : energy[q] / 4;
+        int child = build(out, oldChild ? oldChild : -1, childEnergy, threshold, depth + 1, maxDepth);
+        out.nodes[index].child[q] = child;
+    }
+    return index;
+}
+
+DTree DTree::refined(float rho, int maxDepth) const
+{
+    DTree out;
+    out.nodes.clear();
+    float energy[4];
+    for (int q = 0; q < 4; ++q)
+        energy[q] = nodes[0].sum[q];
+    build(out, 0, energy, rho * total(), 1, maxDepth);
+    return out;
+}
+
+PathGuide::PathGuide(const Bounds3 &bounds) : nodes(1), bounds(bounds) {}
+
+int PathGuide::leafIndex(const Vector3f &p) const
+{
+    Vector3f o = bounds.Offset(p);
+    float x[3] = {o.x, o.y, o.z};
+    int index = 0;
+    while (nodes[index].child[0] != 0) {
+        int axis = nodes[index].axis;
+        int side = x[axis] >= 0.5f;
+        x[axis] = x[axis] * 2 - side;
+        index = nodes[index].child[side];
+    }
+    return index;
+}
+
+void PathGuide::record(const Vector3f &p, const Vector3f &dir, float radiance)
+{
+    if (!(radiance > 0) || std::isinf(radiance))
+        return;
+    DTree &dtree = nodes[leafIndex(p)].building;
+    dtree.record(dir, radiance);
+    dtree.samples++;
+}
+
+const DTree *PathGuide::find(const Vector3f &p) const
+{
+    const DTree &dtree = nodes[leafIndex(p)].sampling;
+    return dtree.total() > 0 ? &dtree : nullptr;
+}
+
+// 两个子节点都拿到父节点方向树的拷贝（样本数减半），依次沿 x, y, z 轴对半分
+void PathGuide::subdivide(int index, long threshold)
+{
+    if (nodes[index].building.samples <= threshold)
+        return;
+    int axis = nodes[index].axis;
+    DTree half = nodes[index].building;
+    half.samples = half.samples / 2;
+    for (int side = 0; side < 2; ++side) {
+        SNode child;
+        child.axis = (axis + 1) % 3;
+        child.building = half;
+        nodes.push_back(child);
+        nodes[index].child[side] = nodes.size() - 1;
+    }
+    nodes[index].building = DTree();
+    subdivide(nodes[index].child[0], threshold);
+    subdivide(nodes[index].child[1], threshold);
+}
+
+void PathGuide::refine(int iteration)
+{
+    // 阈值随每轮样本数翻倍按 sqrt 增长，和 Müller 等人的 SD-tree 一样
+    long threshold = (long)(spatialThreshold * std::sqrt(std::pow(2.0, iteration)));
+    for (int k = 0, n = nodes.size(); k < n; ++k)
+        if (nodes[k].child[0] == 0)
+            subdivide(k, threshold);
+    for (auto &node : nodes) {
+        if (node.child[0] != 0)
+            continue;
+        node.sampling = node.building;
+        node.building = node.sampling.refined(0.01f, 20);
+    }
+}
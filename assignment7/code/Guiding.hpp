@@ -0,0 +1,90 @@
+//
+// Path guiding: an adaptive spatial-directional radiance cache (SD-tree).
+//
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include "Vector.hpp"
+#include "Bounds3.hpp"
+
+/**
+ * @brief
+ * 方向四叉树：单位球用等面积的柱面映射 (cosθ, φ) 摊平到 [0,1]^2，
+ * 每个节点记录四个象限里累计的入射辐射（Li / pdf），按能量比例采样方向。
+ */
+class DTree
+{
+public:
+    DTree();
+
+    void record(const Vector3f &dir, float value);
+    // 立体角上的概率密度
+    float pdf(const Vector3f &dir) const;
+    Vector3f sample() const;
+    float total() const;
+    // 按这一轮的能量重新划分：能量占比超过 rho 的象限细分，其余合并成叶子，新树的能量清零
+    DTree refined(float rho, int maxDepth) const;
+
+    std::atomic<long> samples{0};
+
+    DTree(const DTree &other);
+    DTree &operator=(const DTree &other);
+
+private:
+    struct Node
+    {
+        std::atomic<float> sum[4];
+        // 子节点下标，0 表示这个象限是叶子
+        int child[4] = {0, 0, 0, 0};
+
+        Node();
+        Node(const Node &other);
+        Node &operator=(const Node &other);
+        float total() const;
+    };
+    std::vector<Node> nodes;
+
+    int build(DTree &out, int oldIndex, const float energy[4], float threshold, int depth, int maxDepth) const;
+};
+
+/**
+ * @brief
+ * 空间上的二叉树，每个叶子一对方向树：building 在当前这一轮训练中累计，
+ * sampling 是上一轮的结果，渲染时只读。两轮之间调用 refine 交换并细分。
+ */
+class PathGuide
+{
+public:
+    explicit PathGuide(const Bounds3 &bounds);
+
+    // 训练阶段打开，castRay 会把每次间接光照的结果记下来
+    bool recording = false;
+    // one-sample MIS 中按材质采样的概率，其余按学到的分布采样
+    float bsdfSamplingFraction = 0.5f;
+    // 训练用的总 spp，按 1, 2, 4... 分成若干轮
+    int trainingSpp = 15;
+    // 空间叶子的样本数超过 spatialThreshold * sqrt(2^iteration) 就一分为二
+    long spatialThreshold = 12000;
+
+    void record(const Vector3f &p, const Vector3f &dir, float radiance);
+    // p 所在叶子的采样分布，还没学到东西时返回 nullptr
+    const DTree *find(const Vector3f &p) const;
+    // 一轮训练结束：样本多的空间叶子一分为二，方向树按能量细分
+    void refine(int iteration);
+
+private:
+    struct SNode
+    {
+        int axis = 0;
+        // 0 表示叶子
+        int child[2] = {0, 0};
+        DTree building, sampling;
+    };
+    std::vector<SNode> nodes;
+    Bounds3 bounds;
+
+    int leafIndex(const Vector3f &p) const;
+    void subdivide(int index, long threshold);
+};
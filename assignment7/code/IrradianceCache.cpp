@@ -0,0 +1,210 @@
+//
+// Irradiance cache (Ward & Heckbert) for diffuse indirect illumination.
+//
+
+#include "IrradianceCache.hpp"
+#include "Scene.hpp"
+
+IrradianceCache::Node::Node(const Vector3f &c, float h) : center(c), halfSize(h)
+{
+    for (auto &c : child)
+        c = nullptr;
+}
+
+IrradianceCache::Node::~Node()
+{
+    for (auto &c : child)
+        delete c.load();
+    for (Record *r = head.load(); r != nullptr;) {
+        Record *next = r->next;
+        delete r;
+        r = next;
+    }
+}
+
+IrradianceCache::IrradianceCache(const Bounds3 &bounds)
+{
+    Vector3f d = bounds.Diagonal();
+    float size = std::max(d.x, std::max(d.y, d.z));
+    // 根节点取成稍大一点的立方体，让边界上的点也落在里面
+    root = new Node(0.5 * (bounds.pMin + bounds.pMax), 0.51f * size);
+    minSpacing = 0.005f * d.norm();
+    maxSpacing = 0.1f * d.norm();
+}
+
+IrradianceCache::~IrradianceCache()
+{
+    delete root;
+}
+
+// 和 Material::toWorld 一样的方式构造切平面上的两个轴
+static void tangentFrame(const Vector3f &N, Vector3f &B, Vector3f &C)
+{
+    if (std::fabs(N.x) > std::fabs(N.y)) {
+        float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
+        C = Vector3f(N.z * invLen, 0.0f, -N.x * invLen);
+    } else {
+        float invLen = 1.0f / std::sqrt(N.y * N.y + N.z * N.z);
+        C = Vector3f(0.0f, N.z * invLen, -N.y * invLen);
+    }
+    B = crossProduct(C, N);
+}
+
+static float channel(const Vector3f &v, int c)
+{
+    return c == 0 ? v.x : (c == 1 ? v.y : v.z);
+}
+
+/**
+ * @brief
+ * 按 cos 加权分层采样半球，同时算出 Ward & Heckbert 1992 的旋转梯度和平移梯度。
+ * 只统计打到非光源表面的光线，和 castRay 里 L_indir 的定义一致（直接光照另外算）。
+ */
+IrradianceCache::Record *IrradianceCache::computeRecord(const Scene &scene, const Vector3f &p, const Vector3f &n) const
+{
+    const int M = thetaStrata, N = phiStrata;
+    std::vector<Vector3f> L(M * N, Vector3f(0.0f));
+    std::vector<float> r(M * N, kInfinity);
+    Vector3f B, C;
+    tangentFrame(n, B, C);
+
+    float invDistanceSum = 0;
+    for (int j = 0; j < M; ++j)
+        for (int k = 0; k < N; ++k) {
+            float sinTheta = std::sqrt((j + get_random_float()) / M);
+            float cosTheta = std::sqrt(std::max(0.0f, 1 - sinTheta * sinTheta));
+            float phi = 2 * M_PI * (k + get_random_float()) / N;
+            Vector3f dir = sinTheta * std::cos(phi) * B + sinTheta * std::sin(phi) * C + cosTheta * n;
+            Ray ray(p, dir);
+            Intersection hit = scene.intersect(ray);
+            if (!hit.happened)
+                continue;
+            r[j * N + k] = hit.distance;
+            invDistanceSum += 1 / std::max((float)hit.distance, minSpacing);
+            if (!hit.m->hasEmission())
+                L[j * N + k] = scene.castRay(ray, 1);
+        }
+
+    Record *record = new Record();
+    record->p = p;
+    record->n = n;
+    record->E = Vector3f(0.0f);
+    for (auto &l : L)
+        record->E += l;
+    record->E = record->E * (M_PI / (M * N));
+    record->R = invDistanceSum > 0 ? M * N / invDistanceSum : maxSpacing;
+    record->R = clamp(minSpacing, maxSpacing, record->R);
+
+    for (int c = 0; c < 3; ++c) {
+        record->gradR[c] = Vector3f(0.0f);
+        record->gradT[c] = Vector3f(0.0f);
+    }
+    for (int k = 0; k < N; ++k) {
+        float phi = 2 * M_PI * (k + 0.5f) / N, phiMinus = 2 * M_PI * k / N;
+        Vector3f u = std::cos(phi) * B + std::sin(phi) * C;
+        Vector3f v = -std::sin(phi) * B + std::cos(phi) * C;
+        Vector3f vMinus = -std::sin(phiMinus) * B + std::cos(phiMinus) * C;
+        int kPrev = (k + N - 1) % N;
+        for (int c = 0; c < 3; ++c) {
+            float rotational = 0, thetaTerm = 0, phiTerm = 0;
+            for (int j = 0; j < M; ++j) {
+                float Ljk = channel(L[j * N + k], c);
+                float sinTheta = std::sqrt((j + 0.5f) / M);
+                rotational -= sinTheta / std::sqrt(std::max(1e-6f, 1 - sinTheta * sinTheta)) * Ljk;
+
+                // θ 方向相邻两格之间的边界 θ_j-
+                if (j > 0) {
+                    float sinMinus2 = (float)j / M;
+                    float rMin = std::min(r[j * N + k], r[(j - 1) * N + k]);
+                    thetaTerm += std::sqrt(sinMinus2) * (1 - sinMinus2) / rMin *
+                                 (Ljk - channel(L[(j - 1) * N + k], c));
+                }
+                // φ 方向相邻两格之间的边界 φ_k-
+                float rMin = std::min(r[j * N + k], r[j * N + kPrev]);
+                phiTerm += (std::sqrt((j + 1.0f) / M) - std::sqrt((float)j / M)) / rMin *
+                           (Ljk - channel(L[j * N + kPrev], c));
+            }
+            Vector3f &gradR = record->gradR[c], &gradT = record->gradT[c];
+            gradR += v * (rotational * M_PI / (M * N));
+            gradT += u * (thetaTerm * 2 * M_PI / N) + vMinus * phiTerm;
+        }
+    }
+    return record;
+}
+
+// 记录放在 side 落在 [2aR, 4aR) 的那层节点里，查询时只需要看扩大了一半边长的邻域
+void IrradianceCache::insert(Record *record)
+{
+    float influence = error * record->R;
+    Node *node = root;
+    while (node->halfSize > 2 * influence) {
+        const Vector3f &c = node->center;
+        int index = (record->p.x > c.x) | ((record->p.y > c.y) << 1) | ((record->p.z > c.z) << 2);
+        Node *child = node->child[index].load(std::memory_order_acquire);
+        if (child == nullptr) {
+            float h = node->halfSize / 2;
+            Vector3f center(c.x + (index & 1 ? h : -h), c.y + (index & 2 ? h : -h), c.z + (index & 4 ? h : -h));
+            Node *created = new Node(center, h);
+            if (node->child[index].compare_exchange_strong(child, created, std::memory_order_acq_rel))
+                child = created;
+            else
+                delete created;
+        }
+        node = child;
+    }
+    record->next = node->head.load(std::memory_order_relaxed);
+    while (!node->head.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                             std::memory_order_relaxed))
+        ;
+    recordCount++;
+}
+
+void IrradianceCache::lookup(const Node *node, const Vector3f &p, const Vector3f &n, Vector3f &sum, float &weight) const
+{
+    for (const Record *r = node->head.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        Vector3f d = p - r->p;
+        float normalTerm = std::sqrt(std::max(0.0f, 1 - dotProduct(n, r->n)));
+        float w = 1 / (d.norm() / r->R + normalTerm + 1e-6f);
+        if (w <= 1 / error)
+            continue;
+        // 记录在着色点前面（被当前表面挡住的一侧）时不能用
+        if (dotProduct(d, normalize(n + r->n)) < -0.05f * r->R)
+            continue;
+        Vector3f axis = crossProduct(r->n, n);
+        Vector3f E(r->E.x + dotProduct(axis, r->gradR[0]) + dotProduct(d, r->gradT[0]),
+                   r->E.y + dotProduct(axis, r->gradR[1]) + dotProduct(d, r->gradT[1]),
+                   r->E.z + dotProduct(axis, r->gradR[2]) + dotProduct(d, r->gradT[2]));
+        sum += w * Vector3f(std::max(0.0f, E.x), std::max(0.0f, E.y), std::max(0.0f, E.z));
+        weight += w;
+    }
+    for (auto &c : node->child) {
+        const Node *child = c.load(std::memory_order_acquire);
+        if (child == nullptr)
+            continue;
+        float reach = 2 * child->halfSize;
+        Vector3f o = p - child->center;
+        if (std::fabs(o.x) <= reach && std::fabs(o.y) <= reach && std::fabs(o.z) <= reach)
+            lookup(child, p, n, sum, weight);
+    }
+}
+
+bool IrradianceCache::lookup(const Vector3f &p, const Vector3f &n, Vector3f &E) const
+{
+    Vector3f sum(0.0f);
+    float weight = 0;
+    lookup(root, p, n, sum, weight);
+    if (weight <= 0)
+        return false;
+    E = sum / weight;
+    return true;
+}
+
+Vector3f IrradianceCache::getIrradiance(const Scene &scene, const Vector3f &p, const Vector3f &n)
+{
+    Vector3f E;
+    if (lookup(p, n, E))
+        return E;
+    Record *record = computeRecord(scene, p, n);
+    insert(record);
+    return record->E;
+}
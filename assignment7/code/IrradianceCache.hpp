@@ -0,0 +1,64 @@
+//
+// Irradiance cache (Ward & Heckbert) for diffuse indirect illumination.
+//
+
+#pragma once
+
+#include <atomic>
+#include "Vector.hpp"
+#include "Bounds3.hpp"
+
+class Scene;
+
+/**
+ * @brief
+ * 在稀疏的点上用很多条光线算出间接光的 irradiance，存进八叉树，附近的着色点用梯度插值复用。
+ * 插入是无锁的：子节点指针和每个节点的记录链表头都用 CAS 挂上去，读的一方不需要加锁，
+ * 记录一旦挂上就不会再改，直到整个 cache 析构。
+ */
+class IrradianceCache
+{
+public:
+    explicit IrradianceCache(const Bounds3 &bounds);
+    ~IrradianceCache();
+
+    // Ward 的误差阈值 a，越小记录越密
+    float error = 0.2f;
+    // 每条记录在半球上分 M x N 个分层采样（θ 方向 M 份，φ 方向 N 份）
+    int thetaStrata = 12;
+    int phiStrata = 36;
+
+    // p 点（法线 n）处来自非光源表面的 irradiance；附近没有可用的记录时就地算一条新的并插入
+    Vector3f getIrradiance(const Scene &scene, const Vector3f &p, const Vector3f &n);
+    // 只做插值，附近没有记录返回 false
+    bool lookup(const Vector3f &p, const Vector3f &n, Vector3f &E) const;
+
+    std::atomic<int> recordCount{0};
+
+private:
+    struct Record
+    {
+        Vector3f p, n, E;
+        // 到周围表面的调和平均距离，限制在 [minSpacing, maxSpacing] 内
+        float R;
+        // 每个颜色通道一个旋转梯度和平移梯度
+        Vector3f gradR[3], gradT[3];
+        Record *next;
+    };
+    struct Node
+    {
+        Vector3f center;
+        float halfSize;
+        std::atomic<Node *> child[8];
+        std::atomic<Record *> head{nullptr};
+
+        Node(const Vector3f &c, float h);
+        ~Node();
+    };
+    Node *root;
+    float minSpacing, maxSpacing;
+
+    Record *computeRecord(const Scene &scene, const Vector3f &p, const Vector3f &n) const;
+    void insert(Record *record);
+    void lookup(const Node *node, const Vector3f &p, const Vector3f &n, Vector3f &sum, float &weight) const;
+};
@@ -8,6 +8,12 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <condition_variable>
+#include <queue>
 
 // 线程锁
 std::mutex mtx;
@@ -17,68 +23,342 @@ inline float deg2rad(const float &deg) { return deg * M_PI / 180.0; }
 
 const float EPSILON = 0.00001;
 
-// The main render function. This where we iterate over all pixels in the image,
-// generate primary rays and cast these rays into the scene. The content of the
-// framebuffer is saved to a file.
-void Renderer::Render(const Scene &scene)
+// Ctrl-C 只设置标志位，渐进式渲染在当前行结束后停下并把已有的结果写出去
+static std::atomic<bool> stopRequested{false};
+static void onInterrupt(int) { stopRequested = true; }
+
+static Vector3f primaryDirection(const Scene &scene, float scale, float imageAspectRatio, int i, int j)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    float x = (2 * (i + 0.5) / (float)scene.width - 1) *
+              imageAspectRatio * scale;
+    float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
+    return normalize(Vector3f(-x, y, 1));
+}
+
+void writePPM(const std::string &filename, const Scene &scene, const std::vector<Vector3f> &framebuffer)
+{
+    FILE *fp = fopen(filename.c_str(), "wb");
+    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
+    for (auto i = 0; i < scene.height * scene.width; ++i)
+    {
+        static unsigned char color[3];
+        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
+        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
+        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
+        fwrite(color, 1, 3, fp);
+    }
+    fclose(fp);
+}
+
+// 用所有核按行动态分配任务，每个线程处理完一行再去取下一行
+static void parallelRows(int height, const std::function<void(int)> &renderRow)
+{
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<int> nextRow{0};
+    std::vector<std::thread> th;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        th.emplace_back([&]() {
+            for (int j = nextRow++; j < height; j = nextRow++)
+                renderRow(j);
+        });
+    }
+    for (auto &t : th)
+        t.join();
+}
 
+// 路径引导的训练：按 1, 2, 4... spp 渲染若干轮（结果丢掉），每轮都把间接光照记进 guide，
+// 轮与轮之间细分 SD-tree，让后面的轮次用前面学到的分布采样
+static void trainGuide(const Scene &scene, float scale, float imageAspectRatio, const Vector3f &eye_pos)
+{
+    PathGuide *guide = scene.guide;
+    guide->recording = true;
+    int iteration = 0;
+    for (int used = 0, s = 1; used + s <= guide->trainingSpp; used += s, s *= 2, ++iteration) {
+        parallelRows(scene.height, [&](int j) {
+            for (int i = 0; i < scene.width; ++i) {
+                Vector3f dir = primaryDirection(scene, scale, imageAspectRatio, i, j);
+                for (int k = 0; k < s; ++k)
+                    scene.castRay(Ray(eye_pos, dir), 0);
+            }
+        });
+        guide->refine(iteration);
+        std::cout << "guide training iteration " << iteration << ": " << s << " spp\n";
+    }
+    guide->recording = false;
+}
+
+// irradiance cache 的预处理：在越来越密的像素网格上找到第一个交点并查询 cache，
+// 让记录在正式渲染前就铺开，避免记录的分布依赖于线程的执行顺序
+static void seedIrradianceCache(const Scene &scene, float scale, float imageAspectRatio, const Vector3f &eye_pos)
+{
+    for (int s = 16; s >= 4; s /= 2) {
+        parallelRows(scene.height, [&](int j) {
+            if (j % s != 0)
+                return;
+            for (int i = 0; i < scene.width; i += s) {
+                Intersection hit = scene.intersect(Ray(eye_pos, primaryDirection(scene, scale, imageAspectRatio, i, j)));
+                if (hit.happened && !hit.m->hasEmission())
+                    scene.irradianceCache->getIrradiance(scene, hit.coords, hit.normal.normalized());
+            }
+        });
+        std::cout << "irradiance cache seeding, stride " << s << ": "
+                  << scene.irradianceCache->recordCount << " records\n";
+    }
+}
+
+void Renderer::Prepare(const Scene &scene)
+{
     float scale = tan(deg2rad(scene.fov * 0.5));
     float imageAspectRatio = scene.width / (float)scene.height;
     Vector3f eye_pos(278, 273, -800);
-    int m = 0;
 
-    // change the spp value to change sample ammount
-    int spp = 16;
-    std::cout << "SPP: " << spp << "\n";
+    if (scene.guide)
+        trainGuide(scene, scale, imageAspectRatio, eye_pos);
+    if (scene.irradianceCache)
+        seedIrradianceCache(scene, scale, imageAspectRatio, eye_pos);
+}
 
-    int num_threads = 32;
-    std::thread th[num_threads];
-    // 对每个线程负责的部分进行划分
-    int thread_height = scene.height / num_threads;
-    // 构造&析构函数
-    auto renderRows = [&](uint32_t start_height, uint32_t end_height)
-    {
-        for (uint32_t j = start_height; j < end_height; ++j) {
-            for (uint32_t i = 0; i < scene.width; ++i) {
-                // generate primary ray direction
-                float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                        imageAspectRatio * scale;
-                float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-                Vector3f dir = normalize(Vector3f(-x, y, 1));
-                for (int k = 0; k < spp; k++){
-                    framebuffer[(int)(j*scene.width+i)] += scene.castRay(Ray(eye_pos, dir), 0) / spp;  
-                }
+// Renders rows [rowBegin, rowEnd) at full spp and stores the unnormalised
+// radiance sums. Every sample is seeded from its (pixel, sample) index, so the
+// result does not depend on which thread or process renders the row.
+void Renderer::RenderRows(const Scene &scene, int rowBegin, int rowEnd, std::vector<Vector3f> &sum, bool showProgress)
+{
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+
+    sum.assign((rowEnd - rowBegin) * scene.width, Vector3f(0.0f));
+    parallelRows(rowEnd - rowBegin, [&](int row) {
+        int j = rowBegin + row;
+        for (int i = 0; i < scene.width; ++i) {
+            // generate primary ray direction
+            Vector3f dir = primaryDirection(scene, scale, imageAspectRatio, i, j);
+            Vector3f &s = sum[row * scene.width + i];
+            for (int k = 0; k < spp; k++) {
+                seed_random(j * scene.width + i, k);
+                s += scene.castRay(Ray(eye_pos, dir), 0);
             }
+        }
+        if (showProgress) {
             mtx.lock();
             progress++;
             UpdateProgress(progress / (float)scene.height);
             mtx.unlock();
-        } };
+        }
+    });
+}
 
-    for (int t = 0; t < num_threads; ++t)
-    {
-        th[t] = std::thread(renderRows, t * thread_height, (t + 1) * thread_height);
-    }
-    for (int t = 0; t < num_threads; ++t)
-    {
-        // 等待线程结束并清理资源（会阻塞）
-        th[t].join();
-    }
+// The main render function. This where we iterate over all pixels in the image,
+// generate primary rays and cast these rays into the scene. The content of the
+// framebuffer is saved to a file.
+void Renderer::Render(const Scene &scene)
+{
+    std::cout << "SPP: " << spp << "\n";
+    Prepare(scene);
+
+    // 之前按 32 个线程平分行数，height 不能整除时最后几行不会被渲染；现在按行动态分配
+    std::vector<Vector3f> framebuffer;
+    RenderRows(scene, 0, scene.height, framebuffer, true);
+    for (auto &pixel : framebuffer)
+        pixel = pixel / spp;
     UpdateProgress(1.f);
 
     // save framebuffer to file
-    FILE *fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
+    writePPM("binary.ppm", scene, framebuffer);
+}
+
+// Coarse-to-fine preview. Every sample ever traced is kept in sum/count, so a
+// later pass only adds samples and never recomputes earlier ones.
+void Renderer::RenderProgressive(const Scene &scene, const ProgressiveOptions &options)
+{
+    int width = scene.width, height = scene.height;
+    std::vector<Vector3f> sum(width * height);
+    std::vector<int> count(width * height, 0);
+    std::vector<Vector3f> preview(width * height);
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = width / (float)height;
+    Vector3f eye_pos(278, 273, -800);
+
+    stopRequested = false;
+    auto previousHandler = std::signal(SIGINT, onInterrupt);
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    // 训练时间也算在 elapsed 里，这样和不引导的渲染比较时是等时间的
+    Prepare(scene);
+    double lastWrite = -1e30;
+    bool dirty = false;
+    // 已经跑过的 stride，从细到粗
+    std::vector<int> strides;
+
+    // 还没有采样的像素用所在 stride x stride 块左上角那个像素的值填充，
+    // 当前这一遍被中断时退回到更粗一级的网格
+    auto publish = [&](int pass, bool force) {
+        if (options.filename.empty())
+            return;
+        double t = elapsed();
+        dirty = true;
+        if (!force && t - lastWrite < options.interval)
+            return;
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i) {
+                int p = j * width + i, q = p;
+                for (size_t k = 0; count[q] == 0 && k < strides.size(); ++k)
+                    q = (j - j % strides[k]) * width + (i - i % strides[k]);
+                preview[p] = count[q] > 0 ? sum[q] / count[q] : Vector3f(0.0f);
+            }
+        writePPM(options.filename, scene, preview);
+        lastWrite = t;
+        dirty = false;
+        std::cout << "pass " << pass << ": stride " << (strides.empty() ? 0 : strides.front()) << ", "
+                  << t << " s, wrote " << options.filename << "\n";
+    };
+    auto shouldStop = [&]() {
+        return stopRequested || (options.timeLimit > 0 && elapsed() > options.timeLimit);
+    };
+
+    int pass = 0;
+    // 分辨率逐步加倍：每一遍只补上当前 stride 网格里还没采样过的像素
+    for (int s = std::max(1, options.startStride); s >= 1 && !shouldStop(); s /= 2, ++pass) {
+        parallelRows(height, [&](int j) {
+            if (j % s != 0 || shouldStop())
+                return;
+            for (int i = 0; i < width; i += s) {
+                int p = j * width + i;
+                if (count[p] > 0)
+                    continue;
+                seed_random(p, 0);
+                sum[p] += scene.castRay(Ray(eye_pos, primaryDirection(scene, scale, imageAspectRatio, i, j)), 0);
+                count[p] = 1;
+            }
+        });
+        strides.insert(strides.begin(), s);
+        if (options.onPass)
+            options.onPass(pass, elapsed(), sum, count);
+        publish(pass, false);
+    }
+
+    // 全分辨率之后按 1, 2, 4... 追加采样，直到每个像素都有 options.spp 个
+    for (int have = 1, add = 1; have < options.spp && !shouldStop(); have += add, add *= 2, ++pass) {
+        if (options.maxSamplesPerPass > 0)
+            add = std::min(add, options.maxSamplesPerPass);
+        add = std::min(add, options.spp - have);
+        parallelRows(height, [&](int j) {
+            if (shouldStop())
+                return;
+            for (int i = 0; i < width; ++i) {
+                int p = j * width + i;
+                Vector3f dir = primaryDirection(scene, scale, imageAspectRatio, i, j);
+                for (int k = 0; k < add; ++k) {
+                    seed_random(p, count[p] + k);
+                    sum[p] += scene.castRay(Ray(eye_pos, dir), 0);
+                }
+                count[p] += add;
+            }
+        });
+        if (options.onPass)
+            options.onPass(pass, elapsed(), sum, count);
+        publish(pass, false);
+    }
+
+    // 最后一遍如果因为 interval 没有写出，这里补写一次
+    if (dirty)
+        publish(pass - 1, true);
+    std::signal(SIGINT, previousHandler);
+}
+
+// 转台 / 相机路径：引导和 irradiance cache 是世界空间的，用默认视角训练 / 播种一次后所有帧共用。
+// 块按 (帧, 块) 排队，第 f 帧像素 p 的第 k 个采样用 seed_random(f * width * height + p, k)
+void Renderer::RenderFrames(const Scene &scene, std::vector<Camera> cameras, const std::string &pattern)
+{
+    struct Frame
     {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
+        std::once_flag allocated;
+        std::vector<Vector3f> pixels;
+        std::atomic<int> tilesLeft{0};
+    };
+
+    std::cout << "SPP: " << spp << ", " << cameras.size() << " frames\n";
+    Prepare(scene);
+
+    int numFrames = cameras.size();
+    for (auto &camera : cameras)
+        camera.prepare(scene.width, scene.height);
+
+    int tilesX = (scene.width + tileSize - 1) / tileSize;
+    int tilesY = (scene.height + tileSize - 1) / tileSize;
+    int tilesPerFrame = tilesX * tilesY;
+    int numJobs = numFrames * tilesPerFrame;
+    std::vector<Frame> frames(numFrames);
+    for (auto &frame : frames)
+        frame.tilesLeft = tilesPerFrame;
+    std::atomic<int> nextJob{0};
+    int tilesDone = 0;
+    std::mutex frameMtx;
+
+    // 写图线程：等完成的帧号，写完释放帧缓冲
+    std::queue<int> readyFrames;
+    bool allRendered = false;
+    std::condition_variable frameReady;
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> lock(frameMtx);
+        while (true) {
+            frameReady.wait(lock, [&] { return !readyFrames.empty() || allRendered; });
+            if (readyFrames.empty())
+                return;
+            int f = readyFrames.front();
+            readyFrames.pop();
+            lock.unlock();
+            char filename[256];
+            snprintf(filename, sizeof(filename), pattern.c_str(), f);
+            writePPM(filename, scene, frames[f].pixels);
+            std::vector<Vector3f>().swap(frames[f].pixels);
+            lock.lock();
+        }
+    });
+
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> th;
+    for (int t = 0; t < num_threads; ++t) {
+        th.emplace_back([&]() {
+            for (int job = nextJob++; job < numJobs; job = nextJob++) {
+                int f = job / tilesPerFrame, tile = job % tilesPerFrame;
+                Frame &frame = frames[f];
+                const Camera &camera = cameras[f];
+                std::call_once(frame.allocated, [&] { frame.pixels.resize(scene.width * scene.height); });
+                int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+                int x1 = std::min(x0 + tileSize, scene.width), y1 = std::min(y0 + tileSize, scene.height);
+                for (int j = y0; j < y1; ++j)
+                    for (int i = x0; i < x1; ++i) {
+                        int p = j * scene.width + i;
+                        Vector3f dir = camera.direction(i, j);
+                        Vector3f s(0.0f);
+                        for (int k = 0; k < spp; ++k) {
+                            seed_random(f * scene.width * scene.height + p, k);
+                            s += scene.castRay(Ray(camera.eye, dir), 0);
+                        }
+                        frame.pixels[p] = s / spp;
+                    }
+
+                std::lock_guard<std::mutex> lock(frameMtx);
+                if (--frame.tilesLeft == 0) {
+                    readyFrames.push(f);
+                    frameReady.notify_one();
+                }
+                UpdateProgress(++tilesDone / (float)numJobs);
+            }
+        });
     }
-    fclose(fp);
+    for (auto &t : th)
+        t.join();
+    {
+        std::lock_guard<std::mutex> lock(frameMtx);
+        allRendered = true;
+        frameReady.notify_one();
+    }
+    writer.join();
+    UpdateProgress(1.f);
 }
@@ -2,6 +2,9 @@
 // Created by goksu on 2/25/20.
 //
 #include "Scene.hpp"
+#include "Camera.hpp"
+#include <string>
+#include <functional>
 
 #pragma once
 struct hit_payload
@@ -12,10 +15,46 @@ struct hit_payload
     Object* hit_obj;
 };
 
+// 渐进式预览：先用 1/startStride 的分辨率每像素 1 spp 出图，然后逐步加密到全分辨率，
+// 最后按 1, 2, 4... 的速度给所有像素追加采样直到 spp。所有采样都累加到同一个缓冲里，不会重复计算。
+struct ProgressiveOptions
+{
+    int spp = 16;
+    int startStride = 8;
+    // 两次写出预览图之间的最短间隔（秒），0 表示每一遍都写
+    float interval = 1.0f;
+    // 超过这个时间（秒）就在当前这一遍结束后停止，0 表示不限制。
+    // 每次判断都重新读，onPass 可以通过原对象把它推后（benchmark 用来补回统计误差花的时间）
+    float timeLimit = 0.0f;
+    // 全分辨率之后每一遍最多追加的 spp，0 表示不限制（一直翻倍）
+    int maxSamplesPerPass = 0;
+    // 预览图文件名，空字符串表示不写
+    std::string filename = "binary.ppm";
+    // 每一遍结束时回调，拿到累加缓冲（sum / count 就是当前估计），benchmark 用它来统计误差
+    std::function<void(int pass, double seconds, const std::vector<Vector3f>& sum,
+                       const std::vector<int>& count)> onPass;
+};
+
+void writePPM(const std::string &filename, const Scene &scene, const std::vector<Vector3f> &framebuffer);
+
 class Renderer
 {
 public:
     void Render(const Scene& scene);
+    // 训练路径引导、播种 irradiance cache（场景里没开的跳过）。Render / RenderProgressive / RenderFrames
+    // 开始时自己会调；直接用 RenderRows 的（分布式的 worker）要在第一次 RenderRows 之前调一次
+    void Prepare(const Scene& scene);
+    // 渲染 [rowBegin, rowEnd) 这些行，sum 里是每个像素 spp 个采样的 radiance 之和（没有除以 spp）
+    void RenderRows(const Scene& scene, int rowBegin, int rowEnd, std::vector<Vector3f>& sum, bool showProgress = false);
+    void RenderProgressive(const Scene& scene, const ProgressiveOptions& options);
+    // 依次渲染 cameras 里的每个相机（每像素 spp 个采样），第 f 帧写到 printf(pattern, f)
+    void RenderFrames(const Scene& scene, std::vector<Camera> cameras,
+                      const std::string& pattern = "frame_%04d.ppm");
+
+    // change the spp value to change sample ammount
+    int spp = 16;
+    // RenderFrames 里线程每次领取的块的边长（像素）
+    int tileSize = 16;
 
 private:
 };
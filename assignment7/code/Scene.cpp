@@ -116,6 +116,11 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
        L_dir = light_pos.emit * obj_pos.m->eval(ws, wo, N) * dotProduct(ws, NN) * dotProduct(-ws, N) / std::pow(ws_distance, 2) / light_pdf; 
     }
     
+    // 第一个交点（漫反射）的间接光照从 irradiance cache 里插值：L_indir = f_r * E，不再往下递归
+    if (irradianceCache && depth == 0) {
+        return L_dir + irradianceCache->getIrradiance(*this, obj_pos.coords, N) * obj_pos.m->eval(ws, wo, N);
+    }
+
     // 俄罗斯转盘做法
     float ksi = get_random_float();
     if( ksi > RussianRoulette ){
@@ -129,7 +134,22 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
     Intersection obj_output_pos;
     // 采样拿到wi和pdf，这里想法是反过来，从点p采样出来的光线是从点q出发射到点p的，所以是wi
     // 这里的点q还没有通过intersect方法查找
-    Vector3f wi = -obj_pos.m->sample(ray.direction, N);
+    Vector3f wi;
+    float obj_pdf;
+    const DTree *dtree = guide ? guide->find(obj_pos.coords) : nullptr;
+    if (dtree == nullptr) {
+        wi = -obj_pos.m->sample(ray.direction, N);
+        obj_pdf = obj_pos.m->pdf(wi, wo, N);
+    } else {
+        // 路径引导：按 bsdfSamplingFraction 的概率用材质采样，否则按学到的入射辐射分布采样，
+        // pdf 取两者的混合（one-sample MIS）。引导出来的方向可能在表面下面，这时贡献为 0
+        float alpha = guide->bsdfSamplingFraction;
+        Vector3f dir = get_random_float() < alpha ? obj_pos.m->sample(ray.direction, N) : dtree->sample();
+        if (dotProduct(dir, N) <= 0)
+            return L_dir;
+        wi = -dir;
+        obj_pdf = alpha * obj_pos.m->pdf(wi, wo, N) + (1 - alpha) * dtree->pdf(dir);
+    }
 
     // 需要判断点p出射出去光线是否碰到一个non-emitting的物体，如果碰到光源呢？
     // 重新构建一条光线，从点p朝着wi的方向走，这里要注意一下wi的方向
@@ -137,11 +157,14 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
     Intersection q_pos = Scene::intersect(p_ray);
 
     if( q_pos.happened ){
-        float obj_pdf = obj_pos.m->pdf(wi, wo, N);
         // 这里判断不是光源，问题是，如果是遇到光源呢？
         if( q_pos.m->hasEmission() == false ){
             // shade(q, wi)*eval(wo, wi, N)*dot(wi, N)/pdf(wo, wi, N)/RussianRoulette
-            L_indir = this->castRay(p_ray, depth+1) * obj_pos.m->eval(wi, wo, N) * dotProduct(-wi, obj_pos.normal) / obj_pdf / RussianRoulette;         
+            Vector3f L_i = this->castRay(p_ray, depth+1);
+            L_indir = L_i * obj_pos.m->eval(wi, wo, N) * dotProduct(-wi, obj_pos.normal) / obj_pdf / RussianRoulette;
+            // 训练阶段记录 Li / pdf，方向树里的能量就是入射辐射的蒙特卡洛估计
+            if (guide && guide->recording)
+                guide->record(obj_pos.coords, -wi, (L_i.x + L_i.y + L_i.z) / 3 / obj_pdf);
         }
     }
     return L_dir + L_indir;
@@ -10,6 +10,8 @@
 #include "Light.hpp"
 #include "AreaLight.hpp"
 #include "BVH.hpp"
+#include "Guiding.hpp"
+#include "IrradianceCache.hpp"
 #include "Ray.hpp"
 
 
@@ -34,6 +36,10 @@ public:
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
     BVHAccel *bvh;
+    // 不为空时打开路径引导，Renderer 会先用它训练几轮再正式渲染
+    PathGuide *guide = nullptr;
+    // 不为空时第一个交点的间接光照改用 irradiance cache 插值
+    IrradianceCache *irradianceCache = nullptr;
     void buildBVH();
     Vector3f castRay(const Ray &ray, int depth) const;
     void sampleLight(Intersection &pos, float &pdf) const;
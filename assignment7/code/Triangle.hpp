@@ -90,7 +90,8 @@ public:
 class MeshTriangle : public Object
 {
 public:
-    MeshTriangle(const std::string& filename, Material *mt = new Material())
+    MeshTriangle(const std::string& filename, Material *mt = new Material(),
+                 BVHAccel::BuildMode buildMode = BVHAccel::BuildMode::EAGER)
     {
         objl::Loader loader;
         loader.LoadFile(filename);
@@ -133,7 +134,7 @@ public:
             ptrs.push_back(&tri);
             area += tri.area;
         }
-        bvh = new BVHAccel(ptrs);
+        bvh = new BVHAccel(ptrs, 1, BVHAccel::SplitMethod::NAIVE, buildMode);
     }
 
     bool intersect(const Ray& ray) { return true; }
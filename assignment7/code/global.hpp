@@ -2,6 +2,7 @@
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <cstdint>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -28,6 +29,64 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
+/**
+ * @brief PCG32（O'Neill 的 pcg32_random_r）：64 位状态，满足 UniformRandomBitGenerator。
+ * 重新设种子只要两次乘加，每个采样都重设也不贵（mt19937 重设一次要填 624 个字）
+ */
+struct pcg32
+{
+    using result_type = uint32_t;
+
+    uint64_t state = 0x853c49e6748fea9bull;
+    uint64_t inc = 0xda3e39cb94b95bdbull;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+    void seed(uint64_t initstate, uint64_t initseq = 0xda3e39cb94b95bdbull)
+    {
+        state = 0;
+        inc = (initseq << 1u) | 1u;
+        (*this)();
+        state += initstate;
+        (*this)();
+    }
+
+    result_type operator()()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+};
+
+// 每个线程一个随机数生成器，只在第一次使用时用 random_device 初始化
+inline pcg32 &random_engine()
+{
+    thread_local pcg32 rng = [] {
+        pcg32 r;
+        r.seed(((uint64_t)std::random_device{}() << 32) | std::random_device{}());
+        return r;
+    }();
+    return rng;
+}
+
+/**
+ * @brief 按 (像素, 采样序号) 重新设置当前线程的种子。
+ * 每个采样用到的随机数只和它自己的编号有关，和线程调度、进程划分无关，
+ * 所以分布式渲染拼起来的结果和单进程渲染逐位相同
+ */
+inline void seed_random(uint32_t pixel, uint32_t sample)
+{
+    // splitmix64 的混合函数，结果作为 PCG 的初始状态
+    uint64_t z = ((uint64_t)pixel << 32 | sample) + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    random_engine().seed(z ^ (z >> 31));
+}
+
 /**
  * @brief Get the random float object
  * 
@@ -35,12 +94,10 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
  */
 inline float get_random_float()
 {
-    std::random_device dev;
-    std::mt19937 rng(dev());
     // 产生均匀分布在区间 [a, b) 上的随机浮点值 i 
     std::uniform_real_distribution<float> dist(0.f, 1.f); // distribution in range [1, 6]
 
-    return dist(rng);
+    return dist(random_engine());
 }
 
 inline void UpdateProgress(float progress)
@@ -1,4 +1,6 @@
 #include "Renderer.hpp"
+#include "Benchmark.hpp"
+#include "Distributed.hpp"
 #include "Scene.hpp"
 #include "Triangle.hpp"
 #include "Sphere.hpp"
@@ -12,6 +14,71 @@
 // function().
 int main(int argc, char** argv)
 {
+    // --lazy-bvh: 网格内部的 BVH 只建前几层，剩下的在渲染时按需展开
+    // --progressive: 先出低分辨率预览，再逐步细化（--interval 控制写图间隔，--time-limit 控制总时长）
+    // --make-reference ref.pfm: 用 --spp 渲染参考图；--benchmark ref.pfm: 记录误差随时间的收敛曲线
+    auto bvhMode = BVHAccel::BuildMode::EAGER;
+    bool progressive = false;
+    ProgressiveOptions options;
+    BenchmarkOptions benchmark;
+    // --guide: 路径引导，--guide-training N: 训练用的 spp
+    bool guiding = false;
+    int guideTrainingSpp = 15;
+    // --irradiance-cache: 第一个交点的间接光照用 irradiance cache，--ic-error a: Ward 的误差阈值
+    bool irradianceCaching = false;
+    float cacheError = 0.2f;
+    std::string referenceOutput;
+    // --distributed N: 启动 N 个 worker 进程分行渲染，--rows-per-job R: 每次派发的行数
+    // --worker r w: 由 coordinator 加上，r / w 是任务和结果管道的文件描述符
+    int workers = 0, rowsPerJob = 8;
+    int workerReadFd = -1, workerWriteFd = -1;
+    // --turntable N: 绕 Cornell box 中心转一圈渲染 N 帧，--camera-path file: 每行 "ex ey ez tx ty tz [fov]"，
+    // 都输出 frame_%04d.ppm
+    int turntableFrames = 0;
+    std::string cameraPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--lazy-bvh")
+            bvhMode = BVHAccel::BuildMode::LAZY;
+        else if (arg == "--progressive")
+            progressive = true;
+        else if (arg == "--spp" && i + 1 < argc)
+            options.spp = std::stoi(argv[++i]);
+        else if (arg == "--interval" && i + 1 < argc)
+            options.interval = std::stof(argv[++i]);
+        else if (arg == "--time-limit" && i + 1 < argc)
+            options.timeLimit = std::stof(argv[++i]);
+        else if (arg == "--guide")
+            guiding = true;
+        else if (arg == "--guide-training" && i + 1 < argc)
+            guideTrainingSpp = std::stoi(argv[++i]);
+        else if (arg == "--irradiance-cache")
+            irradianceCaching = true;
+        else if (arg == "--ic-error" && i + 1 < argc)
+            cacheError = std::stof(argv[++i]);
+        else if (arg == "--make-reference" && i + 1 < argc)
+            referenceOutput = argv[++i];
+        else if (arg == "--benchmark" && i + 1 < argc)
+            benchmark.reference = argv[++i];
+        else if (arg == "--bench-interval" && i + 1 < argc)
+            benchmark.interval = std::stod(argv[++i]);
+        else if (arg == "--bench-duration" && i + 1 < argc)
+            benchmark.duration = std::stod(argv[++i]);
+        else if (arg == "--target-error" && i + 1 < argc)
+            benchmark.targetError = std::stod(argv[++i]);
+        else if (arg == "--distributed" && i + 1 < argc)
+            workers = std::stoi(argv[++i]);
+        else if (arg == "--rows-per-job" && i + 1 < argc)
+            rowsPerJob = std::stoi(argv[++i]);
+        else if (arg == "--turntable" && i + 1 < argc)
+            turntableFrames = std::stoi(argv[++i]);
+        else if (arg == "--camera-path" && i + 1 < argc)
+            cameraPath = argv[++i];
+        else if (arg == "--worker" && i + 2 < argc) {
+            workerReadFd = std::stoi(argv[++i]);
+            workerWriteFd = std::stoi(argv[++i]);
+        }
+    }
 
     // Change the definition here to change resolution
     Scene scene(784, 784);
@@ -25,12 +92,12 @@ int main(int argc, char** argv)
     Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
     light->Kd = Vector3f(0.65f);
 
-    MeshTriangle floor("../models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("../models/cornellbox/left.obj", red);
-    MeshTriangle right("../models/cornellbox/right.obj", green);
-    MeshTriangle light_("../models/cornellbox/light.obj", light);
+    MeshTriangle floor("../models/cornellbox/floor.obj", white, bvhMode);
+    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white, bvhMode);
+    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white, bvhMode);
+    MeshTriangle left("../models/cornellbox/left.obj", red, bvhMode);
+    MeshTriangle right("../models/cornellbox/right.obj", green, bvhMode);
+    MeshTriangle light_("../models/cornellbox/light.obj", light, bvhMode);
 
     scene.Add(&floor);
     scene.Add(&shortbox);
@@ -40,11 +107,50 @@ int main(int argc, char** argv)
     scene.Add(&light_);
 
     scene.buildBVH();
+    if (guiding) {
+        scene.guide = new PathGuide(scene.bvh->root->bounds);
+        scene.guide->trainingSpp = guideTrainingSpp;
+    }
+    if (irradianceCaching) {
+        scene.irradianceCache = new IrradianceCache(scene.bvh->root->bounds);
+        scene.irradianceCache->error = cacheError;
+    }
 
     Renderer r;
+    r.spp = options.spp;
+
+    if (workerReadFd >= 0) {
+        RunWorker(r, scene, workerReadFd, workerWriteFd);
+        return 0;
+    }
+
+    std::vector<Camera> cameras;
+    if (!cameraPath.empty()) {
+        cameras = LoadCameraPath(cameraPath, scene.fov);
+        if (cameras.empty()) {
+            std::cerr << "no cameras in " << cameraPath << "\n";
+            return 1;
+        }
+    } else if (turntableFrames > 0) {
+        Camera start;
+        start.target = scene.bvh->root->bounds.Centroid();
+        start.fov = scene.fov;
+        cameras = Turntable(start, turntableFrames);
+    }
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    if (!cameras.empty())
+        r.RenderFrames(scene, cameras);
+    else if (!referenceOutput.empty())
+        RenderReference(r, scene, options.spp, referenceOutput);
+    else if (!benchmark.reference.empty())
+        RunConvergenceBenchmark(r, scene, benchmark);
+    else if (workers > 0)
+        RenderDistributed(r, scene, workers, rowsPerJob, argc, argv);
+    else if (progressive)
+        r.RenderProgressive(scene, options);
+    else
+        r.Render(scene);
     auto stop = std::chrono::system_clock::now();
 
     std::cout << "Render complete: \n";